@@ -1,8 +1,39 @@
 #ifndef __ALIGNED_STORAGE__
 #define __ALIGNED_STORAGE__
 
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__cpp_aligned_new)
+template <class T>
+struct IsOverAligned {
+    static const bool value = false;
+};
+#else
+// Before C++17 operator new only guarantees alignof(std::max_align_t).
 template <class T>
+struct IsOverAligned {
+    static const bool value = alignof(T) > alignof(std::max_align_t);
+};
+#endif
+
+// Uninitialized storage for one T. The buffer is declared with alignas(T), so
+// the object sits at a fixed offset and begin() is a plain cast.
+template <class T, bool OverAligned = IsOverAligned<T>::value>
 class AlignedStorage {
+private:
+    alignas(T) uint8_t storage[sizeof(T)];
+
+public:
+    T *begin() {
+        return reinterpret_cast<T *>(storage);
+    }
+};
+
+// Over-aligned types that operator new can not place correctly are aligned by
+// hand inside a buffer with alignof(T) spare bytes.
+template <class T>
+class AlignedStorage<T, true> {
 private:
     uint8_t storage[sizeof(T) + alignof(T)];
 
@@ -0,0 +1,60 @@
+#ifndef __ALLOCATED_STORAGE_HPP__
+#define __ALLOCATED_STORAGE_HPP__
+
+#include <memory>
+#include <utility>
+
+#include "aligned_storage.hpp"
+#include "compressed_member.hpp"
+#include "control_block.hpp"
+
+// Control block of allocate_shared: the counts, the allocator and the object in
+// one allocation made with Alloc rebound to the block. The block is given back
+// to the same allocator with its exact size, and a stateless allocator takes
+// no space. The object is constructed and destroyed through the allocator too,
+// so allocators such as std::pmr::polymorphic_allocator pass themselves on to
+// the object.
+template <class T, class Alloc, class Policy = default_policy>
+class AllocatedStorage : public ControlBlock<Policy>, private CompressedMember<Alloc, 0> {
+private:
+    typedef CompressedMember<Alloc, 0> AllocMember;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<AllocatedStorage> BlockAlloc;
+    typedef std::allocator_traits<BlockAlloc> BlockTraits;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<T> ObjectAlloc;
+    typedef std::allocator_traits<ObjectAlloc> ObjectTraits;
+
+    explicit AllocatedStorage(const Alloc &alloc) : AllocMember(alloc) {}
+
+    void dispose() override {
+        ObjectAlloc alloc(AllocMember::get());
+        ObjectTraits::destroy(alloc, m_storage.begin());
+    }
+
+    void deallocate() override {
+        BlockAlloc alloc(AllocMember::get());
+        this->~AllocatedStorage();
+        BlockTraits::deallocate(alloc, this, 1);
+    }
+
+public:
+    AlignedStorage<T> m_storage;
+
+    template <class... Args>
+    static AllocatedStorage *create(const Alloc &alloc, Args &&...args) {
+        BlockAlloc block_alloc(alloc);
+        AllocatedStorage *block = BlockTraits::allocate(block_alloc, 1);
+        new (block) AllocatedStorage(alloc);
+        try {
+            ObjectAlloc object_alloc(alloc);
+            ObjectTraits::construct(object_alloc, block->m_storage.begin(), std::forward<Args>(args)...);
+        } catch (...) {
+            block->~AllocatedStorage();
+            BlockTraits::deallocate(block_alloc, block, 1);
+            throw;
+        }
+
+        return block;
+    }
+};
+
+#endif // __ALLOCATED_STORAGE_HPP__
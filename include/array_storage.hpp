@@ -0,0 +1,91 @@
+#ifndef __ARRAY_STORAGE_HPP__
+#define __ARRAY_STORAGE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "control_block.hpp"
+
+// Requests an alignment for the elements of make_shared<U[]>(n), for example
+// aligned_to<64>() for AVX-512 loads. Align must be a power of two.
+template <size_t Align>
+struct aligned_to {
+    static_assert(Align != 0 && (Align & (Align - 1)) == 0, "alignment must be a power of two");
+};
+
+// Control block of make_shared<U[]>(n). The counts and the n elements are one
+// allocation: the elements start at the first address after the block that is
+// a multiple of the alignment. Alignments above what operator new guarantees
+// are reached by allocating spare bytes.
+template <class T, size_t Align, class Policy = default_policy>
+class ArrayStorage : public ControlBlock<Policy> {
+private:
+    static const size_t alignment = Align > alignof(T) ? Align : alignof(T);
+
+    size_t m_size;
+
+    explicit ArrayStorage(size_t size) : m_size(size) {}
+
+    static size_t padding() {
+        if (alignment > alignof(std::max_align_t))
+            return alignment - 1;
+
+        return (alignment - sizeof(ArrayStorage) % alignment) % alignment;
+    }
+
+    void destroy_elements(size_t count) {
+        T *elements = begin();
+        while (count > 0)
+            elements[--count].~T();
+    }
+
+    void dispose() override {
+        destroy_elements(m_size);
+    }
+
+    void deallocate() override {
+        this->~ArrayStorage();
+        ::operator delete(this);
+    }
+
+public:
+    T *begin() {
+        uintptr_t address = reinterpret_cast<uintptr_t>(this + 1);
+        return reinterpret_cast<T *>((address + alignment - 1) & ~uintptr_t(alignment - 1));
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    // Elements are value-initialized, T(), or default-initialized, T, which
+    // leaves trivial types such as float uninitialized.
+    template <bool ValueInitialize>
+    static ArrayStorage *create(size_t size) {
+        size_t header = sizeof(ArrayStorage) + padding();
+        if (size > (SIZE_MAX - header) / sizeof(T))
+            throw std::bad_array_new_length();
+
+        ArrayStorage *block = new (::operator new(header + size * sizeof(T))) ArrayStorage(size);
+        T *elements = block->begin();
+        size_t constructed = 0;
+        try {
+            for (; constructed < size; constructed++) {
+                if (ValueInitialize)
+                    new (elements + constructed) T();
+                else
+                    new (elements + constructed) T;
+            }
+        } catch (...) {
+            block->destroy_elements(constructed);
+            block->~ArrayStorage();
+            ::operator delete(block);
+            throw;
+        }
+
+        return block;
+    }
+};
+
+#endif // __ARRAY_STORAGE_HPP__
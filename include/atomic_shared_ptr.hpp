@@ -0,0 +1,217 @@
+#ifndef __ATOMIC_SHARED_PTR_HPP__
+#define __ATOMIC_SHARED_PTR_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "memory.hpp"
+
+// Lock-free slot that holds a shared_ptr or a weak_ptr.
+//
+// The published value lives in an immutable node, Storage<Ptr, atomic_policy>,
+// and the slot is a single word: the node address in the low 48 bits and a
+// local count of readers in the high 16 bits (split reference counting).
+//
+// A reader pins the node with one fetch_add on the slot, takes its own
+// reference on the node and then gives the pin back with a CAS. A writer that
+// swaps the node out moves the pins it has seen into the node's reference
+// count, so a reader whose CAS fails because the node is gone releases one node
+// reference instead. Nodes are never re-published, so a pinned node can not be
+// freed and reused under a reader.
+//
+// The pointer packing relies on 48-bit virtual addresses (x86-64, AArch64) and
+// on less than 65536 threads being inside load() at the same time.
+template <class Ptr>
+class AtomicSlot {
+private:
+    typedef Storage<Ptr, atomic_policy> Node;
+
+    static const int count_shift = 48;
+    static const uintptr_t one_pin = uintptr_t(1) << count_shift;
+    static const uintptr_t pointer_mask = one_pin - 1;
+
+    static_assert(sizeof(uintptr_t) == 8, "AtomicSlot requires 64-bit pointers");
+
+    mutable std::atomic<uintptr_t> m_word;
+
+    static Node *to_node(uintptr_t word) {
+        return reinterpret_cast<Node *>(word & pointer_mask);
+    }
+
+    static uintptr_t to_word(Node *node) {
+        return reinterpret_cast<uintptr_t>(node);
+    }
+
+    static uintptr_t pins(uintptr_t word) {
+        return word >> count_shift;
+    }
+
+    // Values are equivalent if they point to the same object and share
+    // ownership, so an aliased pointer never matches its owner.
+    static bool equivalent(const Ptr &lhs, const Ptr &rhs) {
+        return lhs.m_object == rhs.m_object && lhs.m_shared_storage == rhs.m_shared_storage;
+    }
+
+    // An empty value is published as a null node and costs no allocation.
+    static Node *make_node(Ptr &&ptr) {
+        return equivalent(ptr, Ptr()) ? nullptr : new Node(std::move(ptr));
+    }
+
+    static Ptr value(Node *node) {
+        return node ? *node->m_storage.begin() : Ptr();
+    }
+
+    static void release(Node *node) {
+        if (node)
+            node->release_shared();
+    }
+
+    // Returns the current node with one reference owned by the caller.
+    Node *acquire() const {
+        uintptr_t word = m_word.fetch_add(one_pin, std::memory_order_acquire);
+        Node *node = to_node(word);
+        if (node)
+            node->add_shared();
+
+        word += one_pin;
+        while (to_node(word) == node && pins(word) > 0) {
+            if (m_word.compare_exchange_weak(word, word - one_pin,
+                std::memory_order_relaxed, std::memory_order_relaxed))
+                return node;
+        }
+
+        // The node was swapped out and the writer turned our pin into a node
+        // reference that is ours to drop.
+        release(node);
+        return node;
+    }
+
+    // Publishes `node`, whose reference is handed over to the slot, and returns
+    // the previous node with the slot's reference.
+    Node *exchange_node(Node *node) {
+        uintptr_t word = m_word.exchange(to_word(node), std::memory_order_acq_rel);
+        Node *previous = to_node(word);
+        if (previous && pins(word))
+            previous->add_shared(pins(word));
+
+        return previous;
+    }
+
+    bool compare_exchange(Ptr &expected, Ptr &&desired, bool weak) {
+        Node *node = make_node(std::move(desired));
+        for (;;) {
+            Node *current = acquire();
+            Ptr current_value = value(current);
+            if (!equivalent(current_value, expected)) {
+                expected = std::move(current_value);
+                release(current);
+                release(node);
+                return false;
+            }
+
+            uintptr_t word = m_word.load(std::memory_order_relaxed);
+            while (to_node(word) == current) {
+                if (m_word.compare_exchange_weak(word, to_word(node),
+                    std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    if (current && pins(word))
+                        current->add_shared(pins(word));
+
+                    release(current);
+                    release(current);
+                    return true;
+                }
+            }
+
+            release(current);
+            if (weak) {
+                current = acquire();
+                expected = value(current);
+                release(current);
+                release(node);
+                return false;
+            }
+        }
+    }
+
+public:
+    AtomicSlot() : m_word(0) {}
+
+    explicit AtomicSlot(Ptr desired) : m_word(to_word(make_node(std::move(desired)))) {}
+
+    AtomicSlot(const AtomicSlot &) = delete;
+    AtomicSlot &operator=(const AtomicSlot &) = delete;
+
+    bool is_lock_free() const {
+        return m_word.is_lock_free();
+    }
+
+    Ptr load() const {
+        Node *node = acquire();
+        Ptr ptr = value(node);
+        release(node);
+        return ptr;
+    }
+
+    void store(Ptr desired) {
+        release(exchange_node(make_node(std::move(desired))));
+    }
+
+    Ptr exchange(Ptr desired) {
+        Node *previous = exchange_node(make_node(std::move(desired)));
+        Ptr ptr = value(previous);
+        release(previous);
+        return ptr;
+    }
+
+    bool compare_exchange_weak(Ptr &expected, Ptr desired) {
+        return compare_exchange(expected, std::move(desired), true);
+    }
+
+    bool compare_exchange_strong(Ptr &expected, Ptr desired) {
+        return compare_exchange(expected, std::move(desired), false);
+    }
+
+    ~AtomicSlot() {
+        release(to_node(m_word.load(std::memory_order_acquire)));
+    }
+};
+
+template <class T, class Policy = atomic_policy>
+class atomic_shared_ptr : public AtomicSlot<shared_ptr<T, Policy>> {
+public:
+    atomic_shared_ptr() {}
+
+    atomic_shared_ptr(shared_ptr<T, Policy> desired)
+        : AtomicSlot<shared_ptr<T, Policy>>(std::move(desired)) {}
+
+    atomic_shared_ptr &operator=(shared_ptr<T, Policy> desired) {
+        this->store(std::move(desired));
+        return *this;
+    }
+
+    operator shared_ptr<T, Policy>() const {
+        return this->load();
+    }
+};
+
+template <class T, class Policy = atomic_policy>
+class atomic_weak_ptr : public AtomicSlot<weak_ptr<T, Policy>> {
+public:
+    atomic_weak_ptr() {}
+
+    atomic_weak_ptr(weak_ptr<T, Policy> desired)
+        : AtomicSlot<weak_ptr<T, Policy>>(std::move(desired)) {}
+
+    atomic_weak_ptr &operator=(weak_ptr<T, Policy> desired) {
+        this->store(std::move(desired));
+        return *this;
+    }
+
+    operator weak_ptr<T, Policy>() const {
+        return this->load();
+    }
+};
+
+#endif // __ATOMIC_SHARED_PTR_HPP__
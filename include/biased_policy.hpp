@@ -0,0 +1,216 @@
+#ifndef __BIASED_POLICY_HPP__
+#define __BIASED_POLICY_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "count_policy.hpp"
+#include "thread_mailbox.hpp"
+
+// Biased reference counting.
+//
+// The thread that creates the object is its owner. The owner keeps its share of
+// the references in a biased count that only it writes, so copies and releases
+// on the owner thread are plain loads and stores. All other threads use an
+// atomic shared count, which may go negative when they release references that
+// the owner counted.
+//
+// The object can only die once the two counts are merged:
+// - the owner merges when its biased count drops to zero;
+// - a thread whose release would take an unmerged shared count below zero hands
+//   that reference over to the owner's queue instead, and the owner merges the
+//   object and drops the reference the next time it releases anything, calls
+//   biased_policy::merge_pending() or exits;
+// - once the owner has exited, that thread merges the object itself.
+// After the merge every thread, the owner included, uses the shared count.
+class biased_policy {
+private:
+    // Bits of m_shared: two flags and a signed count of references.
+    static const int64_t merged_flag = 1;
+    static const int64_t queued_flag = 2;
+    static const int64_t one_ref = 4;
+
+    static int64_t refs(int64_t shared) {
+        return (shared - (shared & (one_ref - 1))) / one_ref;
+    }
+
+    std::atomic<int64_t> m_biased{1};
+    std::atomic<int64_t> m_shared{0};
+    std::atomic<size_t> m_weak_count{1};
+    biased_policy *m_next_queued = nullptr;
+    void *m_block = nullptr;
+    void (*m_release_block)(void *) = nullptr;
+
+    // Owner only: biased count is local, so a relaxed load and store suffice.
+    int64_t add_biased(int64_t count) {
+        int64_t biased = m_biased.load(std::memory_order_relaxed) + count;
+        m_biased.store(biased, std::memory_order_relaxed);
+        return biased;
+    }
+
+    // Moves the biased count into the shared count. Runs on the owner thread or,
+    // after the owner has exited, on the single thread that queued the object.
+    // Returns true if no references are left.
+    bool merge() {
+        int64_t biased = m_biased.load(std::memory_order_relaxed);
+        m_biased.store(0, std::memory_order_relaxed);
+        m_merged = true;
+
+        int64_t shared = m_shared.fetch_add(biased * one_ref + merged_flag, std::memory_order_acq_rel);
+        return refs(shared) + biased == 0;
+    }
+
+    void release_queued() {
+        if (refs(m_shared.fetch_sub(one_ref, std::memory_order_acq_rel)) == 1)
+            m_release_block(m_block);
+    }
+
+    void merge_queued() {
+        if (!m_merged && merge()) {
+            m_release_block(m_block);
+            return;
+        }
+
+        release_queued();
+    }
+
+    // Other threads hand the references they can not release over to the
+    // owner, which merges the objects. It names merge_queued(), so the owner
+    // and the members that follow it are declared here.
+    typedef ThreadMailbox<biased_policy, &biased_policy::m_next_queued, &biased_policy::merge_queued>
+        OwnerThread;
+
+    static OwnerThread *current_thread() {
+        return OwnerThread::current();
+    }
+
+    OwnerThread *m_owner;
+    bool m_merged;
+
+    // m_merged is only written by the owner, so other threads must not read it.
+    bool is_owner() const {
+        return m_owner == current_thread() && !m_merged;
+    }
+
+    bool release_remote() {
+        int64_t shared = m_shared.load(std::memory_order_relaxed);
+        for (;;) {
+            if (!(shared & merged_flag) && !(shared & queued_flag) && refs(shared) <= 0) {
+                if (!m_shared.compare_exchange_weak(shared, shared | queued_flag,
+                    std::memory_order_acq_rel, std::memory_order_relaxed))
+                    continue;
+
+                // The reference now belongs to the owner's queue. If the owner
+                // has exited, its biased count is final and can be merged here.
+                if (m_owner->push(this))
+                    return false;
+
+                merge();
+                return refs(m_shared.fetch_sub(one_ref, std::memory_order_acq_rel)) == 1;
+            }
+
+            if (m_shared.compare_exchange_weak(shared, shared - one_ref,
+                std::memory_order_acq_rel, std::memory_order_relaxed))
+                return (shared & merged_flag) && refs(shared) == 1;
+        }
+    }
+
+public:
+    biased_policy() : m_owner(current_thread()), m_merged(m_owner == nullptr) {
+        if (m_owner) {
+            m_owner->add_ref();
+        } else {
+            // Created while the thread is exiting: there is no owner to bias to.
+            m_biased.store(0, std::memory_order_relaxed);
+            m_shared.store(one_ref + merged_flag, std::memory_order_relaxed);
+        }
+    }
+
+    biased_policy(const biased_policy &) = delete;
+    biased_policy &operator=(const biased_policy &) = delete;
+
+    ~biased_policy() {
+        if (m_owner)
+            m_owner->release();
+    }
+
+    template <class Block>
+    void bind(Block *block) {
+        m_block = block;
+        m_release_block = [](void *object) {
+            static_cast<Block *>(object)->destroy_object();
+        };
+    }
+
+    // Merges the objects that other threads handed back to the calling thread.
+    // Releases on the owner thread do this automatically.
+    static void merge_pending() {
+        OwnerThread *owner = current_thread();
+        if (owner)
+            owner->drain();
+    }
+
+    void add_shared() {
+        add_shared(1);
+    }
+
+    void add_shared(size_t count) {
+        if (is_owner())
+            add_biased(count);
+        else
+            m_shared.fetch_add(int64_t(count) * one_ref, std::memory_order_relaxed);
+    }
+
+    // An unmerged object is never destroyed, so only a merged shared count can
+    // refuse the increment.
+    bool try_add_shared() {
+        if (is_owner()) {
+            add_biased(1);
+            return true;
+        }
+
+        int64_t shared = m_shared.load(std::memory_order_relaxed);
+        do {
+            if ((shared & merged_flag) && refs(shared) == 0)
+                return false;
+        } while (!m_shared.compare_exchange_weak(shared, shared + one_ref,
+            std::memory_order_acq_rel, std::memory_order_relaxed));
+
+        return true;
+    }
+
+    bool release_shared() {
+        if (!is_owner())
+            return release_remote();
+
+        if (add_biased(-1) == 0)
+            return merge();
+
+        if (m_owner->has_pending())
+            m_owner->drain();
+
+        return false;
+    }
+
+    void add_weak() {
+        m_weak_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool release_weak() {
+        return m_weak_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    size_t use_count() const {
+        int64_t count = refs(m_shared.load(std::memory_order_relaxed)) +
+            m_biased.load(std::memory_order_relaxed);
+        return count > 0 ? size_t(count) : 0;
+    }
+};
+
+template <class Block>
+void bind_policy(biased_policy &counts, Block *block) {
+    counts.bind(block);
+}
+
+#endif // __BIASED_POLICY_HPP__
@@ -0,0 +1,587 @@
+#ifndef __BLOCK_POOL_HPP__
+#define __BLOCK_POOL_HPP__
+
+#if !defined(SHARED_PTR_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define SHARED_PTR_MMAP_SLABS
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "memory.hpp"
+
+// Pool of small blocks for control blocks, with size classes of 16 bytes up to
+// 512 bytes. Larger requests go to the global operator new.
+//
+// Every thread keeps a freelist per size class, so an allocation or a free on
+// the same thread is a pointer pop or push. A thread that runs out takes a
+// batch of blocks from the global depot, or maps a new slab and hands all but
+// one batch of it to the depot. A thread whose freelist grows past two batches
+// gives one batch back.
+//
+// Every slab belongs to one thread cache, found from a block by masking its
+// address. A block freed on another thread than the slab owner goes back
+// through the owner's lock-free return list, which the owner takes over when
+// it next needs to refill. An owner that stops allocating would keep those
+// blocks, so a thread that finds the depot empty, and trim(), first move the
+// return lists of all caches to the depot. The cache of an exited thread is
+// flushed into the depot and reused by the next thread.
+//
+// A slab whose blocks are all back in the depot can be unmapped: trim() does
+// it at once, and set_idle_timeout() makes the allocation and free slow paths
+// do it for slabs that stay free. Nothing runs those paths while the process
+// is quiet, so an idle process that wants its memory back calls trim() or
+// release_idle(). The depot also counts, per size class, the blocks it has
+// handed out and their peak, which stats() reports.
+//
+// Slabs are mapped with mmap() where it exists, and taken from operator new
+// elsewhere or when SHARED_PTR_NO_MMAP is defined.
+class block_pool {
+public:
+    static const size_t alignment = 16;
+    static const size_t max_block_size = 512;
+    static const size_t slab_size = 64 * 1024;
+    static const size_t batch_size = 32;
+
+    struct size_class_stats {
+        size_t block_size;
+        // Slabs mapped now, at most at once and returned to the system.
+        size_t slabs;
+        size_t peak_slabs;
+        size_t released_slabs;
+        // Blocks in use or cached by threads, now and at most at once.
+        size_t blocks_out;
+        size_t high_water;
+    };
+
+private:
+    static const size_t class_count = max_block_size / alignment;
+    static const size_t header_size = 64;
+
+    struct FreeBlock {
+        FreeBlock *m_next;
+    };
+
+    struct List {
+        FreeBlock *m_head = nullptr;
+        size_t m_size = 0;
+
+        void push(FreeBlock *block) {
+            block->m_next = m_head;
+            m_head = block;
+            m_size++;
+        }
+
+        FreeBlock *pop() {
+            FreeBlock *block = m_head;
+            m_head = block->m_next;
+            m_size--;
+            return block;
+        }
+
+        // Moves the first `count` blocks to a new list.
+        List take(size_t count) {
+            List front;
+            front.m_head = m_head;
+            front.m_size = count;
+
+            FreeBlock *last = m_head;
+            for (size_t i = 1; i < count; i++)
+                last = last->m_next;
+
+            m_head = last->m_next;
+            m_size -= count;
+            last->m_next = nullptr;
+            return front;
+        }
+    };
+
+    class ThreadCache {
+    public:
+        List m_lists[class_count];
+        std::atomic<FreeBlock *> m_remote{nullptr};
+
+        void push_remote(FreeBlock *block) {
+            FreeBlock *head = m_remote.load(std::memory_order_relaxed);
+            do {
+                block->m_next = head;
+            } while (!m_remote.compare_exchange_weak(head, block,
+                std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        FreeBlock *take_remote() {
+            return m_remote.exchange(nullptr, std::memory_order_acquire);
+        }
+    };
+
+    // Header in the first bytes of a slab, the blocks follow it. m_free,
+    // m_idle and m_released belong to the scans of release_free_slabs().
+    struct Slab {
+        ThreadCache *m_owner;
+        size_t m_size_class;
+        void *m_memory;
+        size_t m_free;
+        bool m_idle;
+        bool m_released;
+    };
+
+    static_assert(sizeof(Slab) <= header_size, "slab header does not fit");
+
+    struct SizeClass {
+        std::mutex m_mutex;
+        std::vector<List> m_batches;
+        std::vector<Slab *> m_slabs;
+        size_t m_peak_slabs = 0;
+        size_t m_released_slabs = 0;
+        size_t m_blocks_out = 0;
+        size_t m_high_water = 0;
+        // steady_clock ticks, read without m_mutex so that the slow paths do
+        // not lock the class to find out that it is not due for a scan.
+        std::atomic<int64_t> m_next_scan{0};
+    };
+
+    struct Depot {
+        SizeClass m_classes[class_count];
+
+        std::mutex m_mutex;
+        std::vector<ThreadCache *> m_caches;
+        std::vector<ThreadCache *> m_idle_caches;
+
+        // In milliseconds, 0 turns idle trimming off.
+        std::atomic<int64_t> m_idle_timeout{0};
+
+        // Serves threads whose own cache has already been destroyed at exit.
+        std::mutex m_orphan_mutex;
+        ThreadCache m_orphan_cache;
+
+        Depot() : m_caches(1, &m_orphan_cache) {}
+    };
+
+    class CurrentCache {
+    public:
+        ThreadCache *m_cache = adopt();
+
+        ~CurrentCache() {
+            ThreadCache *cache = m_cache;
+            m_cache = nullptr;
+            retire(cache);
+        }
+    };
+
+    // Never destroyed, so blocks freed during static destruction still find
+    // their depot.
+    static Depot &depot() {
+        static Depot *depot = new Depot();
+        return *depot;
+    }
+
+    static ThreadCache *current() {
+        static thread_local CurrentCache current;
+        return current.m_cache;
+    }
+
+    static size_t size_class(size_t size) {
+        return size ? (size - 1) / alignment : 0;
+    }
+
+    static size_t block_size(size_t index) {
+        return (index + 1) * alignment;
+    }
+
+    static size_t blocks_per_slab(size_t index) {
+        return (slab_size - header_size) / block_size(index);
+    }
+
+    static Slab *slab_of(void *block) {
+        return reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(block) & ~uintptr_t(slab_size - 1));
+    }
+
+    static ThreadCache *adopt() {
+        Depot &pool = depot();
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        if (pool.m_idle_caches.empty()) {
+            pool.m_caches.push_back(new ThreadCache());
+            return pool.m_caches.back();
+        }
+
+        ThreadCache *cache = pool.m_idle_caches.back();
+        pool.m_idle_caches.pop_back();
+        return cache;
+    }
+
+    // Flushes the cache of an exiting thread. Slabs stay owned by the cache,
+    // so blocks that other threads free later wait in its return list for the
+    // next thread that adopts it.
+    static void retire(ThreadCache *cache) {
+        flush(*cache);
+
+        Depot &pool = depot();
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        pool.m_idle_caches.push_back(cache);
+    }
+
+    // Moves all the blocks that a cache holds to the depot.
+    static void flush(ThreadCache &cache) {
+        drain_remote(cache);
+        for (size_t i = 0; i < class_count; i++) {
+            if (cache.m_lists[i].m_size)
+                give_back(i, cache.m_lists[i].take(cache.m_lists[i].m_size));
+        }
+    }
+
+    // The depot functions below run with the size class locked.
+    static void add_batch(SizeClass &bucket, List batch) {
+        bucket.m_batches.push_back(batch);
+        bucket.m_blocks_out -= batch.m_size;
+    }
+
+    static void add_slab(SizeClass &bucket, Slab *slab, size_t blocks) {
+        bucket.m_slabs.push_back(slab);
+        bucket.m_peak_slabs = std::max(bucket.m_peak_slabs, bucket.m_slabs.size());
+        bucket.m_blocks_out += blocks;
+        bucket.m_high_water = std::max(bucket.m_high_water, bucket.m_blocks_out);
+    }
+
+    // Unmaps the slabs whose blocks are all in the depot and returns the
+    // bytes released. With `idle_only`, a slab also has to have been free at
+    // the previous scan.
+    static size_t release_free_slabs(SizeClass &bucket, size_t index, bool idle_only) {
+        for (Slab *slab : bucket.m_slabs)
+            slab->m_free = 0;
+
+        for (const List &batch : bucket.m_batches) {
+            for (FreeBlock *block = batch.m_head; block; block = block->m_next)
+                slab_of(block)->m_free++;
+        }
+
+        size_t released = 0;
+        for (Slab *slab : bucket.m_slabs) {
+            bool free = slab->m_free == blocks_per_slab(index);
+            slab->m_released = free && (slab->m_idle || !idle_only);
+            slab->m_idle = free;
+            released += slab->m_released;
+        }
+
+        if (!released)
+            return 0;
+
+        List kept;
+        for (const List &batch : bucket.m_batches) {
+            FreeBlock *block = batch.m_head;
+            while (block) {
+                FreeBlock *next = block->m_next;
+                if (!slab_of(block)->m_released)
+                    kept.push(block);
+                block = next;
+            }
+        }
+
+        bucket.m_batches.clear();
+        while (kept.m_size)
+            bucket.m_batches.push_back(kept.take(kept.m_size < batch_size ? kept.m_size : batch_size));
+
+        std::vector<Slab *>::iterator end = std::remove_if(bucket.m_slabs.begin(), bucket.m_slabs.end(),
+            [](Slab *slab) {
+                if (!slab->m_released)
+                    return false;
+
+                unmap_slab(slab);
+                return true;
+            });
+        bucket.m_slabs.erase(end, bucket.m_slabs.end());
+        bucket.m_released_slabs += released;
+        return released * slab_size;
+    }
+
+    // Scans a size class for idle slabs at most once per idle timeout, so a
+    // slab is unmapped after it has been free for one to two timeouts. Only
+    // the thread that wins the scan takes the class lock. Called without a
+    // size class locked. Returns the bytes released.
+    static size_t release_idle_slabs(size_t index) {
+        Depot &pool = depot();
+        int64_t timeout = pool.m_idle_timeout.load(std::memory_order_relaxed);
+        if (!timeout)
+            return 0;
+
+        SizeClass &bucket = pool.m_classes[index];
+        typedef std::chrono::steady_clock clock;
+        int64_t now = clock::now().time_since_epoch().count();
+        int64_t next = bucket.m_next_scan.load(std::memory_order_relaxed);
+        if (now < next)
+            return 0;
+
+        int64_t period = std::chrono::duration_cast<clock::duration>(std::chrono::milliseconds(timeout)).count();
+        if (!bucket.m_next_scan.compare_exchange_strong(next, now + period, std::memory_order_relaxed))
+            return 0;
+
+        std::lock_guard<std::mutex> lock(bucket.m_mutex);
+        return release_free_slabs(bucket, index, true);
+    }
+
+    static void give_back(size_t index, List batch) {
+        SizeClass &bucket = depot().m_classes[index];
+        std::lock_guard<std::mutex> lock(bucket.m_mutex);
+        add_batch(bucket, batch);
+    }
+
+    static bool take_batch(size_t index, List &list) {
+        SizeClass &bucket = depot().m_classes[index];
+        std::lock_guard<std::mutex> lock(bucket.m_mutex);
+        if (bucket.m_batches.empty())
+            return false;
+
+        list = bucket.m_batches.back();
+        bucket.m_batches.pop_back();
+        bucket.m_blocks_out += list.m_size;
+        bucket.m_high_water = std::max(bucket.m_high_water, bucket.m_blocks_out);
+        return true;
+    }
+
+    static void free_local(ThreadCache &cache, FreeBlock *block, size_t index) {
+        List &list = cache.m_lists[index];
+        list.push(block);
+        if (list.m_size >= 2 * batch_size) {
+            give_back(index, list.take(batch_size));
+            release_idle_slabs(index);
+        }
+    }
+
+    static void drain_remote(ThreadCache &cache) {
+        FreeBlock *block = cache.take_remote();
+        while (block) {
+            FreeBlock *next = block->m_next;
+            free_local(cache, block, slab_of(block)->m_size_class);
+            block = next;
+        }
+    }
+
+    // Moves the blocks in the return lists of all caches to the depot. Any
+    // thread may take a return list, as taking it is a single exchange.
+    static void collect_remote() {
+        Depot &pool = depot();
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+
+        List lists[class_count];
+        for (ThreadCache *cache : pool.m_caches) {
+            FreeBlock *block = cache->take_remote();
+            while (block) {
+                FreeBlock *next = block->m_next;
+                size_t index = slab_of(block)->m_size_class;
+                lists[index].push(block);
+                if (lists[index].m_size == batch_size)
+                    give_back(index, lists[index].take(batch_size));
+                block = next;
+            }
+        }
+
+        for (size_t i = 0; i < class_count; i++) {
+            if (lists[i].m_size)
+                give_back(i, lists[i].take(lists[i].m_size));
+        }
+    }
+
+    // Maps a slab aligned to its size, so a block finds its slab by masking.
+    // `memory` is set to what unmap_slab() frees.
+    static void *map_slab(void *&memory) {
+#ifdef SHARED_PTR_MMAP_SLABS
+        memory = mmap(nullptr, 2 * slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            throw std::bad_alloc();
+
+        uintptr_t begin = reinterpret_cast<uintptr_t>(memory);
+        uintptr_t slab = (begin + slab_size - 1) & ~uintptr_t(slab_size - 1);
+        if (slab != begin)
+            munmap(memory, slab - begin);
+        if (slab - begin != slab_size)
+            munmap(reinterpret_cast<void *>(slab + slab_size), slab_size - (slab - begin));
+
+        memory = reinterpret_cast<void *>(slab);
+        return memory;
+#else
+        memory = ::operator new(2 * slab_size);
+        uintptr_t begin = reinterpret_cast<uintptr_t>(memory);
+        return reinterpret_cast<void *>((begin + slab_size - 1) & ~uintptr_t(slab_size - 1));
+#endif
+    }
+
+    static void unmap_slab(Slab *slab) {
+#ifdef SHARED_PTR_MMAP_SLABS
+        munmap(slab->m_memory, slab_size);
+#else
+        ::operator delete(slab->m_memory);
+#endif
+    }
+
+    // Keeps one batch of a new slab in the cache and moves the rest to the
+    // depot, so other threads can use it too.
+    static void carve_slab(ThreadCache &cache, size_t index) {
+        void *memory;
+        void *address = map_slab(memory);
+        Slab *slab = new (address) Slab{&cache, index, memory, 0, false, false};
+        char *blocks = reinterpret_cast<char *>(slab) + header_size;
+        size_t size = block_size(index);
+        size_t count = blocks_per_slab(index);
+
+        SizeClass &bucket = depot().m_classes[index];
+        std::lock_guard<std::mutex> lock(bucket.m_mutex);
+        add_slab(bucket, slab, count);
+
+        List batch;
+        for (size_t i = count; i > 0; i--) {
+            batch.push(reinterpret_cast<FreeBlock *>(blocks + (i - 1) * size));
+            if (batch.m_size == batch_size && i > 1) {
+                add_batch(bucket, batch);
+                batch = List();
+            }
+        }
+
+        cache.m_lists[index] = batch;
+    }
+
+    static void *allocate_from(ThreadCache &cache, size_t index) {
+        List &list = cache.m_lists[index];
+        if (!list.m_head) {
+            drain_remote(cache);
+            if (!list.m_head && !take_batch(index, list)) {
+                collect_remote();
+                if (!take_batch(index, list))
+                    carve_slab(cache, index);
+            }
+            release_idle_slabs(index);
+        }
+
+        return list.pop();
+    }
+
+public:
+    static void *allocate(size_t size) {
+        if (size > max_block_size)
+            return ::operator new(size);
+
+        ThreadCache *cache = current();
+        if (cache)
+            return allocate_from(*cache, size_class(size));
+
+        Depot &pool = depot();
+        std::lock_guard<std::mutex> lock(pool.m_orphan_mutex);
+        return allocate_from(pool.m_orphan_cache, size_class(size));
+    }
+
+    // `size` must be the size that the block was allocated with.
+    static void deallocate(void *pointer, size_t size) {
+        if (size > max_block_size) {
+            ::operator delete(pointer);
+            return;
+        }
+
+        FreeBlock *block = static_cast<FreeBlock *>(pointer);
+        Slab *slab = slab_of(pointer);
+        if (slab->m_owner == current())
+            free_local(*slab->m_owner, block, slab->m_size_class);
+        else
+            slab->m_owner->push_remote(block);
+    }
+
+    // Returns the blocks that the calling thread caches and the blocks in the
+    // return lists of all threads to the depot, then unmaps every slab whose
+    // blocks are all there. Blocks that other threads cache keep their slabs
+    // mapped. Returns the bytes released.
+    static size_t trim() {
+        ThreadCache *cache = current();
+        if (cache)
+            flush(*cache);
+        collect_remote();
+
+        size_t released = 0;
+        for (size_t i = 0; i < class_count; i++) {
+            SizeClass &bucket = depot().m_classes[i];
+            std::lock_guard<std::mutex> lock(bucket.m_mutex);
+            released += release_free_slabs(bucket, i, false);
+        }
+
+        return released;
+    }
+
+    // Slabs that stay free for `timeout` are unmapped by the allocation and
+    // free slow paths of their size class. A zero timeout, the default, turns
+    // it off.
+    static void set_idle_timeout(std::chrono::milliseconds timeout) {
+        depot().m_idle_timeout.store(timeout.count(), std::memory_order_relaxed);
+    }
+
+    // Runs the idle scan of set_idle_timeout() now on every size class, for
+    // processes that have gone quiet, for example from a timer. A class whose
+    // last scan is less than one timeout ago is skipped. Returns the bytes
+    // released.
+    static size_t release_idle() {
+        size_t released = 0;
+        for (size_t i = 0; i < class_count; i++)
+            released += release_idle_slabs(i);
+
+        return released;
+    }
+
+    // Statistics of the size class that serves blocks of `size` bytes.
+    static size_class_stats stats(size_t size) {
+        if (size > max_block_size)
+            throw std::out_of_range("block_pool has no size class for this size");
+
+        size_t index = size_class(size);
+        SizeClass &bucket = depot().m_classes[index];
+        std::lock_guard<std::mutex> lock(bucket.m_mutex);
+        return size_class_stats{block_size(index), bucket.m_slabs.size(), bucket.m_peak_slabs,
+            bucket.m_released_slabs, bucket.m_blocks_out, bucket.m_high_water};
+    }
+};
+
+// Stateless allocator that takes its memory from block_pool.
+template <class T>
+class pool_allocator {
+public:
+    typedef T value_type;
+
+    pool_allocator() noexcept {}
+
+    template <class U>
+    pool_allocator(const pool_allocator<U> &) noexcept {}
+
+    T *allocate(size_t count) {
+        static_assert(alignof(T) <= block_pool::alignment, "block_pool does not support over-aligned types");
+
+        if (count > SIZE_MAX / sizeof(T))
+            throw std::bad_array_new_length();
+
+        return static_cast<T *>(block_pool::allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T *pointer, size_t count) noexcept {
+        block_pool::deallocate(pointer, count * sizeof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const pool_allocator<T> &, const pool_allocator<U> &) noexcept {
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const pool_allocator<T> &, const pool_allocator<U> &) noexcept {
+    return false;
+}
+
+// As make_shared, but the control block comes from block_pool.
+template <class T, class Policy = default_policy, class... Args>
+SharedObject<T, Policy> make_pooled(Args &&...args) {
+    return allocate_shared<T, Policy>(pool_allocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif // __BLOCK_POOL_HPP__
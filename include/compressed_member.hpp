@@ -0,0 +1,33 @@
+#ifndef __COMPRESSED_MEMBER_HPP__
+#define __COMPRESSED_MEMBER_HPP__
+
+#include <cstddef>
+#include <type_traits>
+
+// Holds a deleter or an allocator inside a control block. Empty types are kept
+// as a base class, so the empty base optimization gives them no space. Index
+// tells two members of the same type apart.
+template <class T, size_t Index, bool Empty = std::is_empty<T>::value && !std::is_final<T>::value>
+class CompressedMember {
+private:
+    T m_value;
+
+public:
+    explicit CompressedMember(const T &value) : m_value(value) {}
+
+    T &get() {
+        return m_value;
+    }
+};
+
+template <class T, size_t Index>
+class CompressedMember<T, Index, true> : private T {
+public:
+    explicit CompressedMember(const T &value) : T(value) {}
+
+    T &get() {
+        return *this;
+    }
+};
+
+#endif // __COMPRESSED_MEMBER_HPP__
@@ -0,0 +1,160 @@
+#ifndef __CONTROL_BLOCK_HPP__
+#define __CONTROL_BLOCK_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "count_policy.hpp"
+
+// Reference counts shared by all shared_ptr and weak_ptr that own the same
+// object. It has no virtual functions: what happens when the counts drop to
+// zero is decided by the block that derives from it.
+template <class Policy = default_policy>
+class BlockCounts {
+public:
+    Policy m_counts;
+
+    BlockCounts() {}
+
+    BlockCounts(const BlockCounts &) = delete;
+    BlockCounts &operator=(const BlockCounts &) = delete;
+
+    void add_shared() {
+        m_counts.add_shared();
+    }
+
+    void add_shared(size_t count) {
+        m_counts.add_shared(count);
+    }
+
+    bool try_add_shared() {
+        return m_counts.try_add_shared();
+    }
+
+    void add_weak() {
+        m_counts.add_weak();
+    }
+
+    size_t use_count() const {
+        return m_counts.use_count();
+    }
+};
+
+// Control block that may be owned through a pointer to another type than the
+// one it was created for. Derived blocks know how the object is stored:
+// dispose() destroys the object and deallocate() frees the block.
+template <class Policy = default_policy>
+class ControlBlock : public BlockCounts<Policy> {
+public:
+    ControlBlock() {
+        bind_policy(this->m_counts, this);
+    }
+
+    virtual ~ControlBlock() {}
+
+    void release_shared() {
+        if (this->m_counts.release_shared())
+            destroy_object();
+    }
+
+    // Runs once the last shared owner is gone.
+    void destroy_object() {
+        dispose();
+        release_weak();
+    }
+
+    void release_weak() {
+        if (this->m_counts.release_weak())
+            deallocate();
+    }
+
+private:
+    virtual void dispose() = 0;
+    virtual void deallocate() = 0;
+};
+
+// The control block pointer of shared_ptr and weak_ptr.
+//
+// make_shared blocks of trivially destructible objects (Storage<T> with an
+// inline layout) have no virtual functions: there is no destructor to run
+// and the block is freed with operator delete, so they do not need to know
+// their type. Such blocks are marked by the low bit of the pointer, which is
+// only tested when a count drops to zero. Every other block is a ControlBlock.
+template <class Policy = default_policy>
+class BlockPointer {
+private:
+    static const uintptr_t inline_flag = 1;
+
+    uintptr_t m_word;
+
+    bool is_inline() const {
+        return m_word & inline_flag;
+    }
+
+    BlockCounts<Policy> *counts() const {
+        return reinterpret_cast<BlockCounts<Policy> *>(m_word & ~inline_flag);
+    }
+
+    void free_inline() const {
+        BlockCounts<Policy> *block = counts();
+        block->~BlockCounts();
+        ::operator delete(block);
+    }
+
+public:
+    BlockPointer() : m_word(0) {}
+
+    BlockPointer(std::nullptr_t) : m_word(0) {}
+
+    BlockPointer(ControlBlock<Policy> *block)
+        : m_word(reinterpret_cast<uintptr_t>(static_cast<BlockCounts<Policy> *>(block))) {}
+
+    // `block` must start a block allocated with operator new that only needs
+    // ~BlockCounts() to be destroyed.
+    static BlockPointer inline_block(BlockCounts<Policy> *block) {
+        BlockPointer pointer;
+        pointer.m_word = reinterpret_cast<uintptr_t>(block) | inline_flag;
+        return pointer;
+    }
+
+    BlockCounts<Policy> *operator->() const {
+        return counts();
+    }
+
+    explicit operator bool() const {
+        return m_word != 0;
+    }
+
+    // Only valid for blocks that are not inline.
+    ControlBlock<Policy> *control_block() const {
+        return static_cast<ControlBlock<Policy> *>(counts());
+    }
+
+    void release_shared() const {
+        if (!is_inline())
+            control_block()->release_shared();
+        else if (counts()->m_counts.release_shared())
+            release_weak();
+    }
+
+    void release_weak() const {
+        if (!is_inline())
+            control_block()->release_weak();
+        else if (counts()->m_counts.release_weak())
+            free_inline();
+    }
+
+    bool operator==(const BlockPointer &other) const {
+        return m_word == other.m_word;
+    }
+
+    bool operator!=(const BlockPointer &other) const {
+        return m_word != other.m_word;
+    }
+
+    bool operator<(const BlockPointer &other) const {
+        return m_word < other.m_word;
+    }
+};
+
+#endif // __CONTROL_BLOCK_HPP__
@@ -0,0 +1,262 @@
+#ifndef __COUNT_POLICY_HPP__
+#define __COUNT_POLICY_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Reference counting policies for Storage<T, Policy>.
+//
+// Every policy keeps two counters. The shared count is the number of shared_ptr
+// owners. The weak count is the number of weak_ptr observers plus one reference
+// that all the shared owners hold together, so the control block is released
+// exactly once: by whoever drops the weak count to zero.
+//
+// try_add_shared() adds a shared owner only while the object is still alive and
+// is what weak_ptr::lock() is built on.
+//
+// release_shared() returns true for the last shared owner, who must destroy the
+// object and then call release_weak(). release_weak() returns true when the
+// control block itself must be freed.
+
+class single_thread_policy {
+private:
+    size_t m_shared_count = 1;
+    size_t m_weak_count = 1;
+
+public:
+    void add_shared() {
+        m_shared_count++;
+    }
+
+    void add_shared(size_t count) {
+        m_shared_count += count;
+    }
+
+    bool try_add_shared() {
+        if (m_shared_count == 0)
+            return false;
+
+        m_shared_count++;
+        return true;
+    }
+
+    bool release_shared() {
+        return --m_shared_count == 0;
+    }
+
+    void add_weak() {
+        m_weak_count++;
+    }
+
+    bool release_weak() {
+        return --m_weak_count == 0;
+    }
+
+    size_t use_count() const {
+        return m_shared_count;
+    }
+};
+
+class atomic_policy {
+private:
+    std::atomic<size_t> m_shared_count{1};
+    std::atomic<size_t> m_weak_count{1};
+
+public:
+    // A new reference is always made from an existing one, so nothing has to be
+    // ordered against the increment.
+    void add_shared() {
+        m_shared_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void add_shared(size_t count) {
+        m_shared_count.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Increment-if-not-zero: once the count has reached zero the destructor is
+    // running or has run, so the object must never be resurrected.
+    bool try_add_shared() {
+        size_t count = m_shared_count.load(std::memory_order_relaxed);
+        do {
+            if (count == 0)
+                return false;
+        } while (!m_shared_count.compare_exchange_weak(count, count + 1,
+            std::memory_order_acq_rel, std::memory_order_relaxed));
+
+        return true;
+    }
+
+    // The release half publishes every write made through this owner and the
+    // acquire half makes all of them visible to the thread that runs the
+    // destructor. An acq_rel decrement is used instead of a release decrement
+    // followed by an acquire fence because ThreadSanitizer does not model fences.
+    bool release_shared() {
+        return m_shared_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    void add_weak() {
+        m_weak_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The last shared owner drops the weak count only after the destructor has
+    // finished, so the same release/acquire pair orders the destruction of the
+    // object before the control block is freed.
+    bool release_weak() {
+        return m_weak_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    size_t use_count() const {
+        return m_shared_count.load(std::memory_order_relaxed);
+    }
+};
+
+// Compact policies keep both counts in one 64-bit word, 32 bits each, which
+// saves 8 bytes per control block. Taking a count past 2^31 throws
+// std::overflow_error instead of wrapping around.
+class compact_single_thread_policy {
+private:
+    static const uint32_t max_count = uint32_t(1) << 31;
+
+    uint32_t m_shared_count = 1;
+    uint32_t m_weak_count = 1;
+
+    static uint32_t checked_add(uint32_t count, size_t added) {
+        if (added >= max_count || count >= max_count - added)
+            throw std::overflow_error("reference count overflow");
+
+        return count + uint32_t(added);
+    }
+
+public:
+    void add_shared() {
+        m_shared_count = checked_add(m_shared_count, 1);
+    }
+
+    void add_shared(size_t count) {
+        m_shared_count = checked_add(m_shared_count, count);
+    }
+
+    bool try_add_shared() {
+        if (m_shared_count == 0)
+            return false;
+
+        add_shared();
+        return true;
+    }
+
+    bool release_shared() {
+        return --m_shared_count == 0;
+    }
+
+    void add_weak() {
+        m_weak_count = checked_add(m_weak_count, 1);
+    }
+
+    bool release_weak() {
+        return --m_weak_count == 0;
+    }
+
+    size_t use_count() const {
+        return m_shared_count;
+    }
+};
+
+// The shared count is the high half of the word and the weak count the low
+// half. weak_ptr::lock() is a single CAS. The last owner of an object that has
+// no weak_ptr sees both counts at one with a single load: nobody else can
+// reach the block any more, so it clears the word with a plain store, and the
+// following release_weak() finds it empty and frees the block without any
+// read-modify-write.
+class compact_atomic_policy {
+private:
+    static const int shared_shift = 32;
+    static const uint64_t one_shared = uint64_t(1) << shared_shift;
+    static const uint64_t one_weak = 1;
+    static const uint64_t max_count = uint64_t(1) << 31;
+
+    std::atomic<uint64_t> m_counts{one_shared + one_weak};
+
+    static uint64_t shared_count(uint64_t counts) {
+        return counts >> shared_shift;
+    }
+
+    static uint64_t weak_count(uint64_t counts) {
+        return counts & (one_shared - 1);
+    }
+
+    // Counts are kept below 2^31, so concurrent increments that overshoot
+    // before they are undone can not carry into the other half.
+    void add(uint64_t one, size_t count, uint64_t (*get)(uint64_t)) {
+        if (count >= max_count)
+            throw std::overflow_error("reference count overflow");
+
+        uint64_t counts = m_counts.fetch_add(one * count, std::memory_order_relaxed);
+        if (get(counts) + count >= max_count) {
+            m_counts.fetch_sub(one * count, std::memory_order_relaxed);
+            throw std::overflow_error("reference count overflow");
+        }
+    }
+
+public:
+    void add_shared() {
+        add(one_shared, 1, shared_count);
+    }
+
+    void add_shared(size_t count) {
+        add(one_shared, count, shared_count);
+    }
+
+    bool try_add_shared() {
+        uint64_t counts = m_counts.load(std::memory_order_relaxed);
+        do {
+            if (shared_count(counts) == 0)
+                return false;
+            if (shared_count(counts) + 1 >= max_count)
+                throw std::overflow_error("reference count overflow");
+        } while (!m_counts.compare_exchange_weak(counts, counts + one_shared,
+            std::memory_order_acq_rel, std::memory_order_relaxed));
+
+        return true;
+    }
+
+    bool release_shared() {
+        if (m_counts.load(std::memory_order_acquire) == one_shared + one_weak) {
+            m_counts.store(0, std::memory_order_relaxed);
+            return true;
+        }
+
+        return shared_count(m_counts.fetch_sub(one_shared, std::memory_order_acq_rel)) == 1;
+    }
+
+    void add_weak() {
+        add(one_weak, 1, weak_count);
+    }
+
+    bool release_weak() {
+        if (m_counts.load(std::memory_order_relaxed) == 0)
+            return true;
+
+        return weak_count(m_counts.fetch_sub(one_weak, std::memory_order_acq_rel)) == 1;
+    }
+
+    size_t use_count() const {
+        return shared_count(m_counts.load(std::memory_order_relaxed));
+    }
+};
+
+// Called once by every control block as it is created, which may be before its
+// object is constructed. Policies that release objects outside of
+// release_shared() overload it to learn how to do so, and must not call the
+// block before the first release.
+template <class Policy, class Block>
+void bind_policy(Policy &, Block *) {}
+
+#ifdef SHARED_PTR_SINGLE_THREADED
+typedef single_thread_policy default_policy;
+#else
+typedef atomic_policy default_policy;
+#endif
+
+#endif // __COUNT_POLICY_HPP__
@@ -0,0 +1,33 @@
+#ifndef __DEFERRED_NODE_HPP__
+#define __DEFERRED_NODE_HPP__
+
+// Queue link and destroy hook of a control block whose destruction is
+// deferred. It does not depend on the counting policy, so one queue holds
+// blocks of every policy that defers destruction.
+class DeferredNode {
+private:
+    DeferredNode *m_next_deferred = nullptr;
+    void *m_block = nullptr;
+    void (*m_destroy_object)(void *) = nullptr;
+
+    friend class deferred_reclaimer;
+    friend class iterative_teardown;
+
+    template <class Base>
+    friend class owner_thread_policy;
+
+public:
+    template <class Block>
+    void bind(Block *block) {
+        m_block = block;
+        m_destroy_object = [](void *object) {
+            static_cast<Block *>(object)->destroy_object();
+        };
+    }
+
+    void destroy_object() {
+        m_destroy_object(m_block);
+    }
+};
+
+#endif // __DEFERRED_NODE_HPP__
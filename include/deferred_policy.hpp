@@ -0,0 +1,215 @@
+#ifndef __DEFERRED_POLICY_HPP__
+#define __DEFERRED_POLICY_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#include "count_policy.hpp"
+#include "deferred_node.hpp"
+#include "thread_mailbox.hpp"
+
+class biased_policy;
+
+// Queue of objects whose destruction was deferred by deferred_policy. Pushing
+// is a lock-free Treiber stack push, so the thread that drops the last
+// reference pays one CAS. The queue is drained in batches, oldest object
+// first, by drain() or by the background thread that start() launches.
+//
+// At exit the background thread is stopped and the queue is flushed. Objects
+// released after that are destroyed at once.
+class deferred_reclaimer {
+private:
+    struct State {
+        std::atomic<DeferredNode *> m_head{nullptr};
+        std::atomic<size_t> m_pending{0};
+        std::atomic<size_t> m_threshold{0};
+        // Set by the push that wakes the background thread and cleared by the
+        // next drain, so a full queue wakes it once.
+        std::atomic<bool> m_notified{false};
+        std::atomic<bool> m_shut_down{false};
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::thread m_thread;
+        bool m_running = false;
+    };
+
+    // Never destroyed, so releases that run during static destruction still
+    // find a valid queue.
+    static State &state() {
+        static State *state = create_state();
+        return *state;
+    }
+
+    static State *create_state() {
+        State *state = new State();
+        std::atexit(shut_down);
+        return state;
+    }
+
+    // Stops the background thread and flushes the queue at exit.
+    static void shut_down() {
+        stop();
+        state().m_shut_down.store(true, std::memory_order_release);
+        drain();
+    }
+
+    static void run(std::chrono::milliseconds interval) {
+        State &current = state();
+        std::unique_lock<std::mutex> lock(current.m_mutex);
+        while (current.m_running) {
+            current.m_wake.wait_for(lock, interval, [&current]() {
+                return !current.m_running || current.m_notified.load(std::memory_order_relaxed);
+            });
+            lock.unlock();
+            drain();
+            lock.lock();
+        }
+    }
+
+public:
+    static void push(DeferredNode *node) {
+        State &current = state();
+        if (current.m_shut_down.load(std::memory_order_acquire)) {
+            node->destroy_object();
+            return;
+        }
+
+        // Counted before the node is published, so a drain that takes the
+        // node always finds it counted and pending() can not wrap around.
+        size_t pending = current.m_pending.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        DeferredNode *head = current.m_head.load(std::memory_order_relaxed);
+        do {
+            node->m_next_deferred = head;
+        } while (!current.m_head.compare_exchange_weak(head, node,
+            std::memory_order_release, std::memory_order_relaxed));
+
+        // The count may pass the threshold without hitting it, for example
+        // when start() finds a longer queue.
+        size_t threshold = current.m_threshold.load(std::memory_order_relaxed);
+        if (threshold && pending >= threshold && !current.m_notified.load(std::memory_order_relaxed) &&
+            !current.m_notified.exchange(true, std::memory_order_relaxed)) {
+            // Taking the mutex orders the flag before the wait of the
+            // background thread, so the wake-up is not lost.
+            current.m_mutex.lock();
+            current.m_mutex.unlock();
+            current.m_wake.notify_one();
+        }
+    }
+
+    // Destroys every object queued so far on the calling thread and returns
+    // how many there were.
+    static size_t drain() {
+        State &current = state();
+        DeferredNode *node = current.m_head.exchange(nullptr, std::memory_order_acquire);
+        current.m_notified.store(false, std::memory_order_relaxed);
+
+        size_t count = drain_oldest_first<DeferredNode, &DeferredNode::m_next_deferred,
+            &DeferredNode::destroy_object>(node);
+
+        current.m_pending.fetch_sub(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    // Number of objects waiting to be destroyed.
+    static size_t pending() {
+        return state().m_pending.load(std::memory_order_relaxed);
+    }
+
+    // Launches the background thread. It drains the queue every `interval`,
+    // and as soon as `threshold` objects are pending.
+    static void start(size_t threshold = 64,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(10)) {
+        State &current = state();
+        std::lock_guard<std::mutex> lock(current.m_mutex);
+        if (current.m_running)
+            return;
+
+        current.m_threshold.store(threshold, std::memory_order_relaxed);
+        current.m_running = true;
+        current.m_thread = std::thread(run, interval);
+    }
+
+    // Stops the background thread and destroys the objects still queued.
+    static void stop() {
+        State &current = state();
+        {
+            std::lock_guard<std::mutex> lock(current.m_mutex);
+            if (!current.m_running)
+                return;
+
+            current.m_running = false;
+            current.m_threshold.store(0, std::memory_order_relaxed);
+        }
+
+        current.m_wake.notify_one();
+        current.m_thread.join();
+        drain();
+    }
+};
+
+// Deferred destruction.
+//
+// Counts like Base, but when the last shared owner is gone the object is not
+// destroyed by the releasing thread: the control block is pushed onto the
+// deferred_reclaimer queue, and the object is destroyed and the block freed
+// when the queue is drained. For weak_ptr the object is already dead while it
+// waits: lock() fails and use_count() is zero.
+//
+// Base must be thread-safe if the background thread is used, and can not be
+// biased_policy, whose remote releases destroy the object directly.
+template <class Base = atomic_policy>
+class deferred_policy : public DeferredNode {
+private:
+    static_assert(!std::is_same<Base, biased_policy>::value,
+        "deferred_policy can not defer the releases of biased_policy");
+
+    Base m_counts;
+
+public:
+    void add_shared() {
+        m_counts.add_shared();
+    }
+
+    void add_shared(size_t count) {
+        m_counts.add_shared(count);
+    }
+
+    bool try_add_shared() {
+        return m_counts.try_add_shared();
+    }
+
+    // Never reports the last owner, as the reclaimer destroys the object.
+    bool release_shared() {
+        if (m_counts.release_shared())
+            deferred_reclaimer::push(this);
+
+        return false;
+    }
+
+    void add_weak() {
+        m_counts.add_weak();
+    }
+
+    bool release_weak() {
+        return m_counts.release_weak();
+    }
+
+    size_t use_count() const {
+        return m_counts.use_count();
+    }
+};
+
+template <class Base, class Block>
+void bind_policy(deferred_policy<Base> &counts, Block *block) {
+    counts.bind(block);
+}
+
+#endif // __DEFERRED_POLICY_HPP__
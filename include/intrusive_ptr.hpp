@@ -0,0 +1,194 @@
+#ifndef __INTRUSIVE_PTR_HPP__
+#define __INTRUSIVE_PTR_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "count_policy.hpp"
+
+// Reference count embedded in an object by intrusive_ref_counter. Policy only
+// picks the threading model: the single-threaded policies get a plain counter
+// and all the others an atomic one. Objects start with no references.
+template <class Policy>
+class IntrusiveCount {
+private:
+    std::atomic<size_t> m_count{0};
+
+public:
+    void add_ref() {
+        m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns true if the last reference was released.
+    bool release() {
+        return m_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    size_t use_count() const {
+        return m_count.load(std::memory_order_relaxed);
+    }
+};
+
+template <>
+class IntrusiveCount<single_thread_policy> {
+private:
+    size_t m_count = 0;
+
+public:
+    void add_ref() {
+        m_count++;
+    }
+
+    bool release() {
+        return --m_count == 0;
+    }
+
+    size_t use_count() const {
+        return m_count;
+    }
+};
+
+template <>
+class IntrusiveCount<compact_single_thread_policy> : public IntrusiveCount<single_thread_policy> {};
+
+// CRTP base that gives T an embedded reference count and the add_ref and
+// release hooks intrusive_ptr finds through ADL. The count is not copied, as it
+// belongs to the object and not to its value.
+template <class T, class Policy = default_policy>
+class intrusive_ref_counter {
+private:
+    mutable IntrusiveCount<Policy> m_counts;
+
+protected:
+    intrusive_ref_counter() noexcept {}
+
+    intrusive_ref_counter(const intrusive_ref_counter &) noexcept {}
+
+    intrusive_ref_counter &operator=(const intrusive_ref_counter &) noexcept {
+        return *this;
+    }
+
+    ~intrusive_ref_counter() {}
+
+public:
+    size_t use_count() const {
+        return m_counts.use_count();
+    }
+
+    friend void add_ref(const intrusive_ref_counter *counter) {
+        counter->m_counts.add_ref();
+    }
+
+    friend void release(const intrusive_ref_counter *counter) {
+        if (counter->m_counts.release())
+            delete static_cast<const T *>(counter);
+    }
+};
+
+// Single-word owning pointer to an object that counts its own references.
+// The count is reached through `add_ref(T *)` and `release(T *)`, found by ADL:
+// either from intrusive_ref_counter or written for T by hand. As the count is
+// in the object, a raw T * can be turned back into an owning pointer.
+template <class T>
+class intrusive_ptr {
+private:
+    T *m_object;
+
+public:
+    typedef T element_type;
+
+    intrusive_ptr() noexcept : m_object(nullptr) {}
+
+    // Pass `add_reference = false` to adopt a reference the caller already
+    // holds, for example one given up by detach().
+    intrusive_ptr(T *object, bool add_reference = true) : m_object(object) {
+        if (m_object && add_reference)
+            add_ref(m_object);
+    }
+
+    intrusive_ptr(const intrusive_ptr &other) : m_object(other.m_object) {
+        if (m_object)
+            add_ref(m_object);
+    }
+
+    intrusive_ptr(intrusive_ptr &&other) noexcept : m_object(other.m_object) {
+        other.m_object = nullptr;
+    }
+
+    template <class U, typename std::enable_if<std::is_convertible<U *, T *>::value, int>::type = 0>
+    intrusive_ptr(const intrusive_ptr<U> &other) : m_object(other.get()) {
+        if (m_object)
+            add_ref(m_object);
+    }
+
+    template <class U, typename std::enable_if<std::is_convertible<U *, T *>::value, int>::type = 0>
+    intrusive_ptr(intrusive_ptr<U> &&other) noexcept : m_object(other.detach()) {}
+
+    intrusive_ptr &operator=(const intrusive_ptr &other) {
+        intrusive_ptr(other).swap(*this);
+        return *this;
+    }
+
+    intrusive_ptr &operator=(intrusive_ptr &&other) noexcept {
+        intrusive_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    void swap(intrusive_ptr &other) noexcept {
+        std::swap(m_object, other.m_object);
+    }
+
+    void reset() noexcept {
+        intrusive_ptr().swap(*this);
+    }
+
+    void reset(T *object, bool add_reference = true) {
+        intrusive_ptr(object, add_reference).swap(*this);
+    }
+
+    // Gives up ownership without releasing the reference.
+    T *detach() noexcept {
+        T *object = m_object;
+        m_object = nullptr;
+        return object;
+    }
+
+    T &operator*() const {
+        if (m_object)
+            return *m_object;
+
+        throw std::runtime_error("intrusive_ptr has not object for dereferencing");
+    }
+
+    T *operator->() const {
+        return m_object;
+    }
+
+    operator bool() const {
+        return m_object ? true : false;
+    }
+
+    T *get() const {
+        return m_object;
+    }
+
+    ~intrusive_ptr() {
+        if (m_object)
+            release(m_object);
+    }
+};
+
+template <class T, class... Args>
+intrusive_ptr<T> make_intrusive(Args &&...args) {
+    return intrusive_ptr<T>(new T(std::forward<Args>(args)...));
+}
+
+template <class T>
+void swap(intrusive_ptr<T> &lhs, intrusive_ptr<T> &rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+#endif // __INTRUSIVE_PTR_HPP__
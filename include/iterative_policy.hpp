@@ -0,0 +1,175 @@
+#ifndef __ITERATIVE_POLICY_HPP__
+#define __ITERATIVE_POLICY_HPP__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "count_policy.hpp"
+#include "deferred_node.hpp"
+
+// Thread-local worklist of objects under iterative_policy whose last reference
+// is gone. The first last release on a thread destroys objects from the list
+// until it is empty; last releases that happen inside those destructors only
+// push onto the list. A chain of a million nodes is then torn down in a loop
+// instead of a million nested destructor calls.
+//
+// set_budget() caps the number of objects one release destroys, so an event
+// loop can spread a large teardown across ticks with drain() or drain_for().
+// Whatever is left when the thread exits is destroyed then.
+class iterative_teardown {
+public:
+    // Takes over the last releases of the calling thread, as parallel_release
+    // does to turn them into tasks for its pool.
+    class Sink {
+    public:
+        virtual void push(DeferredNode *node) = 0;
+
+    protected:
+        ~Sink() {}
+    };
+
+private:
+    class Worklist {
+    public:
+        DeferredNode *m_head = nullptr;
+        Sink *m_sink = nullptr;
+        size_t m_size = 0;
+        size_t m_budget = SIZE_MAX;
+        bool m_running = false;
+
+        void push(DeferredNode *node) {
+            node->m_next_deferred = m_head;
+            m_head = node;
+            m_size++;
+        }
+
+        // Destroys up to `count` objects, the ones their destructors release
+        // included, and returns how many it destroyed.
+        size_t run(size_t count) {
+            if (m_running)
+                return 0;
+
+            m_running = true;
+            size_t destroyed = 0;
+            while (destroyed < count && m_head) {
+                DeferredNode *node = m_head;
+                m_head = node->m_next_deferred;
+                m_size--;
+                node->destroy_object();
+                destroyed++;
+            }
+
+            m_running = false;
+            return destroyed;
+        }
+
+        ~Worklist() {
+            run(SIZE_MAX);
+        }
+    };
+
+    static Worklist &worklist() {
+        static thread_local Worklist worklist;
+        return worklist;
+    }
+
+public:
+    // Takes a block whose last reference was just released. Returns at once
+    // when called from inside a teardown, otherwise destroys up to the budget.
+    static void release(DeferredNode *node) {
+        Worklist &list = worklist();
+        if (list.m_sink) {
+            list.m_sink->push(node);
+            return;
+        }
+
+        list.push(node);
+        list.run(list.m_budget);
+    }
+
+    // Destroys up to `count` objects and returns how many it destroyed.
+    static size_t drain(size_t count = SIZE_MAX) {
+        return worklist().run(count);
+    }
+
+    // Destroys objects until the list is empty or `duration` has passed, and
+    // returns how many it destroyed.
+    template <class Rep, class Period>
+    static size_t drain_for(std::chrono::duration<Rep, Period> duration) {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + duration;
+        size_t destroyed = 0;
+        while (pending() && std::chrono::steady_clock::now() < deadline)
+            destroyed += drain(64);
+
+        return destroyed;
+    }
+
+    // Sets how many objects a release on the calling thread destroys before
+    // it leaves the rest to drain(). SIZE_MAX, the default, means no limit.
+    static void set_budget(size_t count) {
+        worklist().m_budget = count;
+    }
+
+    // Routes the last releases of the calling thread to `sink`, or back to
+    // the worklist for null.
+    static void set_sink(Sink *sink) {
+        worklist().m_sink = sink;
+    }
+
+    // Number of objects of the calling thread waiting to be destroyed.
+    static size_t pending() {
+        return worklist().m_size;
+    }
+};
+
+// Iterative teardown.
+//
+// Counts like Base, but the last release hands the object to the calling
+// thread's iterative_teardown worklist, so nested releases from destructors
+// never recurse.
+template <class Base = atomic_policy>
+class iterative_policy : public DeferredNode {
+private:
+    Base m_counts;
+
+public:
+    void add_shared() {
+        m_counts.add_shared();
+    }
+
+    void add_shared(size_t count) {
+        m_counts.add_shared(count);
+    }
+
+    bool try_add_shared() {
+        return m_counts.try_add_shared();
+    }
+
+    // The worklist destroys the object, so the last owner is never reported.
+    bool release_shared() {
+        if (m_counts.release_shared())
+            iterative_teardown::release(this);
+
+        return false;
+    }
+
+    void add_weak() {
+        m_counts.add_weak();
+    }
+
+    bool release_weak() {
+        return m_counts.release_weak();
+    }
+
+    size_t use_count() const {
+        return m_counts.use_count();
+    }
+};
+
+template <class Base, class Block>
+void bind_policy(iterative_policy<Base> &counts, Block *block) {
+    counts.bind(block);
+}
+
+#endif // __ITERATIVE_POLICY_HPP__
@@ -1,177 +1,631 @@
 #ifndef __MEMORY_HPP__
 #define __MEMORY_HPP__
 
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "allocated_storage.hpp"
+#include "array_storage.hpp"
+#include "pointer_storage.hpp"
 #include "storage.hpp"
+#include "trailing_storage.hpp"
 
-template <class T>
+class bad_weak_ptr : public std::runtime_error {
+public:
+    bad_weak_ptr() : std::runtime_error("shared_ptr is constructed from expired weak_ptr") {}
+};
+
+template <class T, class Policy = default_policy>
 class weak_ptr;
 
-template <class T>
+template <class T, class Policy = default_policy>
+class shared_ptr;
+
+// make_shared<T>(args...) creates one object and make_shared<U[]>(n) an array.
+template <class T, class Policy>
+using SharedObject = typename std::enable_if<!std::is_array<T>::value, shared_ptr<T, Policy>>::type;
+
+template <class T, class Policy>
+using SharedArray = typename std::enable_if<std::is_array<T>::value && std::extent<T>::value == 0,
+    shared_ptr<T, Policy>>::type;
+
+template <class T, class Policy>
+struct MakeShared;
+
+template <class T, class Policy>
+struct MakeSharedForOverwrite;
+
+template <class T, class Policy>
+struct AllocateShared;
+
+template <class T, class U, class Policy = default_policy, class... Args>
+shared_ptr<T, Policy> make_shared_with_trailing(size_t size, Args &&...args);
+
+template <class T, class Policy = default_policy>
+class enable_shared_from_this;
+
+template <class Ptr>
+class AtomicSlot;
+
+// Allows the converting constructors only from pointers that convert to T *,
+// such as a derived class to its base.
+template <class U, class T>
+using EnableIfConvertible = typename std::enable_if<std::is_convertible<U *, T *>::value, int>::type;
+
+template <class T, class Policy>
 class shared_ptr {
-private:
-    Storage<T> *m_shared_storage;
+public:
+    // T for objects and U for arrays of unknown bound, shared_ptr<U[]>.
+    typedef typename std::remove_extent<T>::type element_type;
 
-    void copy(const shared_ptr<T> &other) {
+private:
+    element_type *m_object;
+    BlockPointer<Policy> m_shared_storage;
+
+    // The count is taken before the pointers are stored, so a policy that
+    // throws leaves nothing to release.
+    void copy(const shared_ptr<T, Policy> &other) {
+        if (other.m_shared_storage)
+            other.m_shared_storage->add_shared();
+        m_object = other.m_object;
         m_shared_storage = other.m_shared_storage;
-        if (m_shared_storage)
-            m_shared_storage->m_shared_count++;
     }
 
-    void copy(const weak_ptr<T> &other) {
-        m_shared_storage = other.m_shared_storage;
-        if (m_shared_storage)
-            m_shared_storage->m_shared_count++;
+    void copy(const weak_ptr<T, Policy> &other) {
+        if (other.m_shared_storage && other.m_shared_storage->try_add_shared()) {
+            m_object = other.m_object;
+            m_shared_storage = other.m_shared_storage;
+        } else {
+            m_object = nullptr;
+            m_shared_storage = nullptr;
+        }
     }
 
     void destroy() {
-        if (m_shared_storage) {
-            m_shared_storage->m_shared_count--;
-            if (m_shared_storage->m_shared_count == 0) {
-                T *obj = m_shared_storage->m_storage.begin();
-                obj->~T();
-
-                if (m_shared_storage->m_weak_count == 0)
-                    delete m_shared_storage;
-            }
-        }
+        if (m_shared_storage)
+            m_shared_storage.release_shared();
+    }
+
+    // Points the weak_ptr inside an enable_shared_from_this base at the new
+    // owner. It only takes a weak reference, so the object does not keep
+    // itself alive.
+    template <class U>
+    void enable_weak_this(const enable_shared_from_this<U, Policy> *base) {
+        if (!base || !base->m_weak_this.expired())
+            return;
+
+        weak_ptr<U, Policy> &weak_this = base->m_weak_this;
+        weak_this.destroy();
+        weak_this.m_object = const_cast<U *>(static_cast<const U *>(m_object));
+        weak_this.m_shared_storage = m_shared_storage;
+        m_shared_storage->add_weak();
+    }
+
+    void enable_weak_this(...) {}
+
+    template <class U>
+    static BlockPointer<Policy> block_pointer(Storage<U, Policy, true> *storage) {
+        return BlockPointer<Policy>::inline_block(storage);
+    }
+
+    static BlockPointer<Policy> block_pointer(ControlBlock<Policy> *storage) {
+        return storage;
+    }
+
+    template <bool Inline>
+    explicit shared_ptr(Storage<T, Policy, Inline> *storage)
+        : m_object(storage->m_storage.begin()), m_shared_storage(block_pointer(storage)) {
+        enable_weak_this(m_object);
+    }
+
+    template <class Alloc>
+    explicit shared_ptr(AllocatedStorage<T, Alloc, Policy> *storage)
+        : m_object(storage->m_storage.begin()), m_shared_storage(storage) {
+        enable_weak_this(m_object);
+    }
+
+    template <size_t Align>
+    explicit shared_ptr(ArrayStorage<element_type, Align, Policy> *storage)
+        : m_object(storage->begin()), m_shared_storage(storage) {}
+
+    template <class U>
+    explicit shared_ptr(TrailingStorage<T, U, Policy> *storage)
+        : m_object(storage->m_storage.begin()), m_shared_storage(storage) {
+        enable_weak_this(m_object);
     }
 
 public:
-    shared_ptr() : m_shared_storage(nullptr) {}
+    shared_ptr() : m_object(nullptr), m_shared_storage(nullptr) {}
     
     shared_ptr(const T object) {
-        m_shared_storage = new Storage<T>(object);
+        Storage<T, Policy> *storage = new Storage<T, Policy>(object);
+        m_object = storage->m_storage.begin();
+        m_shared_storage = block_pointer(storage);
+        enable_weak_this(m_object);
     }
 
-    shared_ptr(const weak_ptr<T> &other) {
+    // Takes ownership of an object allocated elsewhere. `deleter(object)` runs
+    // when the last owner is gone, and the control block is allocated with
+    // `alloc`. If that allocation throws, the object is deleted at once.
+    template <class Deleter, class Alloc = std::allocator<T>>
+    shared_ptr(element_type *object, Deleter deleter, Alloc alloc = Alloc())
+        : m_object(object),
+          m_shared_storage(PointerStorage<element_type, Deleter, Alloc, Policy>::create(object, deleter, alloc)) {
+        enable_weak_this(m_object);
+    }
+
+    shared_ptr(const weak_ptr<T, Policy> &other) {
         copy(other);
+        if (!m_shared_storage)
+            throw bad_weak_ptr();
     }
     
-    shared_ptr(const shared_ptr<T> &other) {
+    shared_ptr(const shared_ptr<T, Policy> &other) {
         copy(other);
     }
 
-    shared_ptr &operator=(const weak_ptr<T> &other) {
+    shared_ptr(shared_ptr<T, Policy> &&other) noexcept
+        : m_object(other.m_object), m_shared_storage(other.m_shared_storage) {
+        other.m_object = nullptr;
+        other.m_shared_storage = nullptr;
+    }
+
+    template <class U, EnableIfConvertible<U, T> = 0>
+    shared_ptr(const shared_ptr<U, Policy> &other)
+        : m_object(other.m_object), m_shared_storage(other.m_shared_storage) {
+        if (m_shared_storage)
+            m_shared_storage->add_shared();
+    }
+
+    template <class U, EnableIfConvertible<U, T> = 0>
+    shared_ptr(shared_ptr<U, Policy> &&other) noexcept
+        : m_object(other.m_object), m_shared_storage(other.m_shared_storage) {
+        other.m_object = nullptr;
+        other.m_shared_storage = nullptr;
+    }
+
+    template <class U, EnableIfConvertible<U, T> = 0>
+    shared_ptr(const weak_ptr<U, Policy> &other) : shared_ptr(other.lock()) {
+        if (!m_shared_storage)
+            throw bad_weak_ptr();
+    }
+
+    // Aliasing constructor: shares ownership with `other` but points to
+    // `object`, usually a member or an element of the object `other` owns.
+    template <class U>
+    shared_ptr(const shared_ptr<U, Policy> &other, element_type *object)
+        : m_object(object), m_shared_storage(other.m_shared_storage) {
+        if (m_shared_storage)
+            m_shared_storage->add_shared();
+    }
+
+    template <class U>
+    shared_ptr(shared_ptr<U, Policy> &&other, element_type *object) noexcept
+        : m_object(object), m_shared_storage(other.m_shared_storage) {
+        other.m_object = nullptr;
+        other.m_shared_storage = nullptr;
+    }
+
+    shared_ptr &operator=(const weak_ptr<T, Policy> &other) {
         if (m_shared_storage != other.m_shared_storage) {
-            destroy();
-            copy(other);
+            other.lock().swap(*this);
+        } else {
+            m_object = other.m_object;
         }
 
         return *this;
     }
     
-    shared_ptr &operator=(const shared_ptr<T> &other) {
+    shared_ptr &operator=(const shared_ptr<T, Policy> &other) {
         if (m_shared_storage != other.m_shared_storage) {
-            destroy();
-            copy(other);
+            shared_ptr<T, Policy>(other).swap(*this);
+        } else {
+            m_object = other.m_object;
         }
 
         return *this;
     }
 
-    T &operator*() const {
-        if (m_shared_storage)
-            return *m_shared_storage->m_storage.begin();
+    shared_ptr &operator=(shared_ptr<T, Policy> &&other) noexcept {
+        shared_ptr<T, Policy>(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    template <class U, EnableIfConvertible<U, T> = 0>
+    shared_ptr &operator=(const shared_ptr<U, Policy> &other) {
+        shared_ptr<T, Policy>(other).swap(*this);
+        return *this;
+    }
+
+    template <class U, EnableIfConvertible<U, T> = 0>
+    shared_ptr &operator=(shared_ptr<U, Policy> &&other) noexcept {
+        shared_ptr<T, Policy>(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    void swap(shared_ptr<T, Policy> &other) noexcept {
+        std::swap(m_object, other.m_object);
+        std::swap(m_shared_storage, other.m_shared_storage);
+    }
+
+    void reset() noexcept {
+        shared_ptr<T, Policy>().swap(*this);
+    }
+
+    element_type &operator*() const {
+        if (m_object)
+            return *m_object;
 
         throw std::runtime_error("shared_ptr has not object for dereferencing");
     }
 
-    T *operator->() const {
-        return m_shared_storage ? m_shared_storage->m_storage.begin() : nullptr;
+    element_type *operator->() const {
+        return m_object;
     }
 
     operator bool() const {
-        return m_shared_storage ? true : false;
+        return m_object ? true : false;
+    }
+
+    element_type *get() const {
+        return m_object;
     }
 
-    T *get() const {
-        return m_shared_storage ? m_shared_storage->m_storage.begin() : nullptr;
+    // Only meaningful for shared_ptr<U[]>.
+    element_type &operator[](ptrdiff_t index) const {
+        return m_object[index];
     }
 
     size_t use_count() const {
-        return m_shared_storage ? m_shared_storage->m_shared_count : 0;
+        return m_shared_storage ? m_shared_storage->use_count() : 0;
+    }
+
+    template <class U>
+    bool owner_before(const shared_ptr<U, Policy> &other) const {
+        return m_shared_storage < other.m_shared_storage;
+    }
+
+    template <class U>
+    bool owner_before(const weak_ptr<U, Policy> &other) const {
+        return m_shared_storage < other.m_shared_storage;
     }
 
     ~shared_ptr() {
         destroy();
     }
 
-    friend class weak_ptr<T>;
+    template <class U, class P>
+    friend class shared_ptr;
+
+    template <class U, class P>
+    friend class weak_ptr;
+
+    template <class Ptr>
+    friend class AtomicSlot;
+
+    template <class U, class P>
+    friend struct MakeShared;
+
+    template <class U, class P>
+    friend struct MakeSharedForOverwrite;
+
+    template <class U, class P>
+    friend struct AllocateShared;
+
+    template <class U, class Tail, class P, class... Args>
+    friend shared_ptr<U, P> make_shared_with_trailing(size_t size, Args &&...args);
+
+    template <class Tail, class U, class P>
+    friend span<Tail> trailing(const shared_ptr<U, P> &ptr);
 };
 
-template <class T>
+template <class T, class Policy>
 class weak_ptr
 {
+public:
+    typedef typename std::remove_extent<T>::type element_type;
+
 private:
-    Storage<T> *m_shared_storage;
+    element_type *m_object;
+    BlockPointer<Policy> m_shared_storage;
 
-    void copy(const shared_ptr<T> &other) {
+    void copy(const shared_ptr<T, Policy> &other) {
+        if (other.m_shared_storage)
+            other.m_shared_storage->add_weak();
+        m_object = other.m_object;
         m_shared_storage = other.m_shared_storage;
-        if (m_shared_storage) {
-            m_shared_storage->m_weak_count++;
-        }
     }
 
-    void copy(const weak_ptr<T> &other) {
+    void copy(const weak_ptr<T, Policy> &other) {
+        if (other.m_shared_storage)
+            other.m_shared_storage->add_weak();
+        m_object = other.m_object;
         m_shared_storage = other.m_shared_storage;
-        if (m_shared_storage)
-            m_shared_storage->m_weak_count++;
     }
 
     void destroy() {
-        if (m_shared_storage) {
-            m_shared_storage->m_weak_count--;
-            if (m_shared_storage->m_shared_count == 0 && m_shared_storage->m_weak_count == 0)
-                delete m_shared_storage;
-        }
+        if (m_shared_storage)
+            m_shared_storage.release_weak();
     }
 
 public:
-    weak_ptr() : m_shared_storage(nullptr) {}
+    weak_ptr() : m_object(nullptr), m_shared_storage(nullptr) {}
 
-    weak_ptr(const shared_ptr<T> &other) {
+    weak_ptr(const shared_ptr<T, Policy> &other) {
        copy(other);
     }
     
-    weak_ptr(const weak_ptr<T> &other) {
+    weak_ptr(const weak_ptr<T, Policy> &other) {
         copy(other);
     }
 
-    weak_ptr &operator=(const shared_ptr<T> &other) {
+    weak_ptr(weak_ptr<T, Policy> &&other) noexcept
+        : m_object(other.m_object), m_shared_storage(other.m_shared_storage) {
+        other.m_object = nullptr;
+        other.m_shared_storage = nullptr;
+    }
+
+    template <class U, EnableIfConvertible<U, T> = 0>
+    weak_ptr(const shared_ptr<U, Policy> &other)
+        : m_object(other.m_object), m_shared_storage(other.m_shared_storage) {
+        if (m_shared_storage)
+            m_shared_storage->add_weak();
+    }
+
+    // Converting U * to T * may have to read the object, as with a virtual
+    // base, so the object is locked for the conversion. An expired weak_ptr
+    // keeps its control block but stores a null pointer.
+    template <class U, EnableIfConvertible<U, T> = 0>
+    weak_ptr(const weak_ptr<U, Policy> &other)
+        : m_object(other.lock().get()), m_shared_storage(other.m_shared_storage) {
+        if (m_shared_storage)
+            m_shared_storage->add_weak();
+    }
+
+    weak_ptr &operator=(const shared_ptr<T, Policy> &other) {
         if (m_shared_storage != other.m_shared_storage) {
-            destroy();
-            copy(other);
+            weak_ptr<T, Policy>(other).swap(*this);
+        } else {
+            m_object = other.m_object;
         }
 
         return *this;
     }
 
-    weak_ptr &operator=(const weak_ptr<T> &other) {
+    weak_ptr &operator=(const weak_ptr<T, Policy> &other) {
         if (m_shared_storage != other.m_shared_storage) {
-            destroy();
-            copy(other);
+            weak_ptr<T, Policy>(other).swap(*this);
+        } else {
+            m_object = other.m_object;
         }
 
         return *this;
     }
 
-    shared_ptr<T> lock() const {
-        return expired() ? shared_ptr<T>() : shared_ptr<T>(*this);
+    weak_ptr &operator=(weak_ptr<T, Policy> &&other) noexcept {
+        weak_ptr<T, Policy>(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    template <class U, EnableIfConvertible<U, T> = 0>
+    weak_ptr &operator=(const shared_ptr<U, Policy> &other) {
+        weak_ptr<T, Policy>(other).swap(*this);
+        return *this;
+    }
+
+    template <class U, EnableIfConvertible<U, T> = 0>
+    weak_ptr &operator=(const weak_ptr<U, Policy> &other) {
+        weak_ptr<T, Policy>(other).swap(*this);
+        return *this;
+    }
+
+    void swap(weak_ptr<T, Policy> &other) noexcept {
+        std::swap(m_object, other.m_object);
+        std::swap(m_shared_storage, other.m_shared_storage);
+    }
+
+    void reset() noexcept {
+        weak_ptr<T, Policy>().swap(*this);
+    }
+
+    shared_ptr<T, Policy> lock() const {
+        shared_ptr<T, Policy> ptr;
+        ptr.copy(*this);
+        return ptr;
     }
 
     size_t use_count() const {
-        return m_shared_storage ? m_shared_storage->m_shared_count : 0;
+        return m_shared_storage ? m_shared_storage->use_count() : 0;
     }
 
     bool expired() const {
         return use_count() ? false : true;
     }
 
+    template <class U>
+    bool owner_before(const shared_ptr<U, Policy> &other) const {
+        return m_shared_storage < other.m_shared_storage;
+    }
+
+    template <class U>
+    bool owner_before(const weak_ptr<U, Policy> &other) const {
+        return m_shared_storage < other.m_shared_storage;
+    }
+
     ~weak_ptr() {
         destroy();
     }
 
-    friend class shared_ptr<T>;
+    template <class U, class P>
+    friend class shared_ptr;
+
+    template <class U, class P>
+    friend class weak_ptr;
+
+    template <class Ptr>
+    friend class AtomicSlot;
+};
+
+// make_shared, make_shared_for_overwrite and allocate_shared are function
+// objects rather than function templates. A name that ordinary lookup finds to
+// be a variable is never looked up by ADL, so an unqualified call does not
+// become ambiguous with std::make_shared when an argument comes from namespace
+// std, such as make_shared<T>(std::string()).
+template <class T, class Policy>
+struct MakeShared {
+    template <class... Args>
+    SharedObject<T, Policy> operator()(Args &&...args) const {
+        return shared_ptr<T, Policy>(new Storage<T, Policy>(std::forward<Args>(args)...));
+    }
+};
+
+// The elements are value-initialized and follow the control block in the
+// same allocation.
+template <class T, class Policy>
+struct MakeShared<T[], Policy> {
+    template <size_t Align = 1>
+    shared_ptr<T[], Policy> operator()(size_t size, aligned_to<Align> = aligned_to<Align>()) const {
+        return shared_ptr<T[], Policy>(ArrayStorage<T, Align, Policy>::template create<true>(size));
+    }
+};
+
+// As make_shared<U[]>(n), but the elements are default-initialized, so a
+// buffer of a trivial type that is about to be overwritten is not zeroed.
+template <class T, class Policy>
+struct MakeSharedForOverwrite<T[], Policy> {
+    template <size_t Align = 1>
+    shared_ptr<T[], Policy> operator()(size_t size, aligned_to<Align> = aligned_to<Align>()) const {
+        return shared_ptr<T[], Policy>(ArrayStorage<T, Align, Policy>::template create<false>(size));
+    }
 };
 
+// As make_shared, but the control block and the object are allocated with
+// `alloc`, which is rebound to the block and kept inside it.
+template <class T, class Policy>
+struct AllocateShared {
+    template <class Alloc, class... Args>
+    SharedObject<T, Policy> operator()(const Alloc &alloc, Args &&...args) const {
+        return shared_ptr<T, Policy>(AllocatedStorage<T, Alloc, Policy>::create(alloc, std::forward<Args>(args)...));
+    }
+};
+
+// One instance of T for every translation unit, as a static data member of a
+// class template is not an ODR violation.
+template <class T>
+struct StaticConst {
+    static constexpr T value{};
+};
+
+template <class T>
+constexpr T StaticConst<T>::value;
+
+template <class T, class Policy = default_policy>
+constexpr const MakeShared<T, Policy> &make_shared = StaticConst<MakeShared<T, Policy>>::value;
+
+template <class T, class Policy = default_policy>
+constexpr const MakeSharedForOverwrite<T, Policy> &make_shared_for_overwrite =
+    StaticConst<MakeSharedForOverwrite<T, Policy>>::value;
+
+template <class T, class Policy = default_policy>
+constexpr const AllocateShared<T, Policy> &allocate_shared = StaticConst<AllocateShared<T, Policy>>::value;
+
+// Creates a T from `args` followed by `size` value-initialized elements of U,
+// all in one allocation with the counts. trailing<U>(ptr) returns the tail.
+template <class T, class U, class Policy, class... Args>
+shared_ptr<T, Policy> make_shared_with_trailing(size_t size, Args &&...args) {
+    return shared_ptr<T, Policy>(TrailingStorage<T, U, Policy>::create(size, std::forward<Args>(args)...));
+}
+
+// Returns the tail of an object created by make_shared_with_trailing<T, U>,
+// or an empty span for an empty `ptr`. `ptr` may be any pointer that shares
+// ownership with that object, but must not come from another factory.
+template <class U, class T, class Policy>
+span<U> trailing(const shared_ptr<T, Policy> &ptr) {
+    if (!ptr.m_shared_storage)
+        return span<U>();
+
+    return static_cast<TrailingBlock<U, Policy> *>(ptr.m_shared_storage.control_block())->tail();
+}
+
+// Base class for objects that need an owning reference to themselves. The
+// factories of shared_ptr set the weak_ptr inside when they take ownership.
+template <class T, class Policy>
+class enable_shared_from_this {
+private:
+    mutable weak_ptr<T, Policy> m_weak_this;
+
+protected:
+    enable_shared_from_this() noexcept {}
+
+    // A copy belongs to a different owner, so the weak_ptr is not copied.
+    enable_shared_from_this(const enable_shared_from_this &) noexcept {}
+
+    enable_shared_from_this &operator=(const enable_shared_from_this &) noexcept {
+        return *this;
+    }
+
+    ~enable_shared_from_this() {}
+
+public:
+    // Throws bad_weak_ptr if the object is not owned by a shared_ptr.
+    shared_ptr<T, Policy> shared_from_this() {
+        return shared_ptr<T, Policy>(m_weak_this);
+    }
+
+    shared_ptr<const T, Policy> shared_from_this() const {
+        return shared_ptr<const T, Policy>(m_weak_this);
+    }
+
+    weak_ptr<T, Policy> weak_from_this() {
+        return m_weak_this;
+    }
+
+    weak_ptr<const T, Policy> weak_from_this() const {
+        return m_weak_this;
+    }
+
+    template <class U, class P>
+    friend class shared_ptr;
+};
+
+// The casts share the control block of `ptr` through the aliasing constructor.
+template <class T, class U, class Policy>
+shared_ptr<T, Policy> static_pointer_cast(const shared_ptr<U, Policy> &ptr) {
+    typedef typename shared_ptr<T, Policy>::element_type element_type;
+    return shared_ptr<T, Policy>(ptr, static_cast<element_type *>(ptr.get()));
+}
+
+// Returns an empty shared_ptr if the object is not a T.
+template <class T, class U, class Policy>
+shared_ptr<T, Policy> dynamic_pointer_cast(const shared_ptr<U, Policy> &ptr) {
+    typedef typename shared_ptr<T, Policy>::element_type element_type;
+    element_type *object = dynamic_cast<element_type *>(ptr.get());
+    return object ? shared_ptr<T, Policy>(ptr, object) : shared_ptr<T, Policy>();
+}
+
+template <class T, class U, class Policy>
+shared_ptr<T, Policy> const_pointer_cast(const shared_ptr<U, Policy> &ptr) {
+    typedef typename shared_ptr<T, Policy>::element_type element_type;
+    return shared_ptr<T, Policy>(ptr, const_cast<element_type *>(ptr.get()));
+}
+
+template <class T, class U, class Policy>
+shared_ptr<T, Policy> reinterpret_pointer_cast(const shared_ptr<U, Policy> &ptr) {
+    typedef typename shared_ptr<T, Policy>::element_type element_type;
+    return shared_ptr<T, Policy>(ptr, reinterpret_cast<element_type *>(ptr.get()));
+}
+
+template <class T, class Policy>
+void swap(shared_ptr<T, Policy> &lhs, shared_ptr<T, Policy> &rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+template <class T, class Policy>
+void swap(weak_ptr<T, Policy> &lhs, weak_ptr<T, Policy> &rhs) noexcept {
+    lhs.swap(rhs);
+}
+
 #endif // __MEMORY_HPP__
@@ -0,0 +1,96 @@
+#ifndef __OWNER_THREAD_POLICY_HPP__
+#define __OWNER_THREAD_POLICY_HPP__
+
+#include <atomic>
+#include <cstddef>
+
+#include "count_policy.hpp"
+#include "deferred_node.hpp"
+#include "thread_mailbox.hpp"
+
+// Owner-thread destruction.
+//
+// Counts like Base, but the object is always destroyed on the thread that
+// created it, for objects that hold thread-local arenas or event-loop handles.
+// A last release on another thread pushes the block into the owner's mailbox,
+// and the owner destroys it on its next owner_thread_policy::poll() or on its
+// next last release. If the owner has already exited, the releasing thread
+// destroys the object itself, as nobody else can.
+template <class Base = atomic_policy>
+class owner_thread_policy : public DeferredNode {
+private:
+    // Other threads post the blocks whose last reference they dropped to the
+    // mailbox of the owner, which destroys them.
+    typedef ThreadMailbox<DeferredNode, &DeferredNode::m_next_deferred, &DeferredNode::destroy_object>
+        Mailbox;
+
+    Base m_counts;
+    Mailbox *m_owner;
+
+public:
+    owner_thread_policy() : m_owner(Mailbox::current()) {
+        if (m_owner)
+            m_owner->add_ref();
+    }
+
+    owner_thread_policy(const owner_thread_policy &) = delete;
+    owner_thread_policy &operator=(const owner_thread_policy &) = delete;
+
+    ~owner_thread_policy() {
+        if (m_owner)
+            m_owner->release();
+    }
+
+    // Destroys the objects that other threads handed back to the calling
+    // thread and returns how many there were.
+    static size_t poll() {
+        Mailbox *mailbox = Mailbox::current();
+        return mailbox ? mailbox->drain() : 0;
+    }
+
+    void add_shared() {
+        m_counts.add_shared();
+    }
+
+    void add_shared(size_t count) {
+        m_counts.add_shared(count);
+    }
+
+    bool try_add_shared() {
+        return m_counts.try_add_shared();
+    }
+
+    bool release_shared() {
+        Mailbox *current = Mailbox::current();
+        if (current == m_owner && current && current->has_pending())
+            current->drain();
+
+        if (!m_counts.release_shared())
+            return false;
+
+        // Created while the thread was exiting: there is no owner.
+        if (!m_owner || current == m_owner)
+            return true;
+
+        return !m_owner->push(this);
+    }
+
+    void add_weak() {
+        m_counts.add_weak();
+    }
+
+    bool release_weak() {
+        return m_counts.release_weak();
+    }
+
+    size_t use_count() const {
+        return m_counts.use_count();
+    }
+};
+
+template <class Base, class Block>
+void bind_policy(owner_thread_policy<Base> &counts, Block *block) {
+    counts.bind(block);
+}
+
+#endif // __OWNER_THREAD_POLICY_HPP__
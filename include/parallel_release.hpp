@@ -0,0 +1,134 @@
+#ifndef __PARALLEL_RELEASE_HPP__
+#define __PARALLEL_RELEASE_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "iterative_policy.hpp"
+#include "memory.hpp"
+
+// Work-stealing pool that destroys a graph of objects under iterative_policy.
+// Every last release on a worker becomes a task on that worker's deque: the
+// worker takes its newest task, which keeps a subtree on one core, and an
+// idle worker steals the oldest task of another, which is usually the root of
+// a large subtree. The pool is done once no task is queued or running.
+class ReleasePool {
+private:
+    class Worker final : public iterative_teardown::Sink {
+    public:
+        ReleasePool *m_pool;
+        std::mutex m_mutex;
+        std::deque<DeferredNode *> m_tasks;
+
+        explicit Worker(ReleasePool *pool) : m_pool(pool) {}
+
+        void push(DeferredNode *node) override {
+            m_pool->m_outstanding.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(node);
+        }
+
+        DeferredNode *pop() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tasks.empty())
+                return nullptr;
+
+            DeferredNode *node = m_tasks.back();
+            m_tasks.pop_back();
+            return node;
+        }
+
+        DeferredNode *steal() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tasks.empty())
+                return nullptr;
+
+            DeferredNode *node = m_tasks.front();
+            m_tasks.pop_front();
+            return node;
+        }
+    };
+
+    std::vector<Worker *> m_workers;
+    std::atomic<size_t> m_outstanding{0};
+
+    DeferredNode *next_task(size_t index) {
+        DeferredNode *node = m_workers[index]->pop();
+        for (size_t i = 1; !node && i < m_workers.size(); i++)
+            node = m_workers[(index + i) % m_workers.size()]->steal();
+
+        return node;
+    }
+
+public:
+    explicit ReleasePool(size_t threads) {
+        for (size_t i = 0; i < threads; i++)
+            m_workers.push_back(new Worker(this));
+    }
+
+    ReleasePool(const ReleasePool &) = delete;
+    ReleasePool &operator=(const ReleasePool &) = delete;
+
+    ~ReleasePool() {
+        for (Worker *worker : m_workers)
+            delete worker;
+    }
+
+    // Makes the last releases of the calling thread tasks of worker `index`.
+    void attach(size_t index) {
+        iterative_teardown::set_sink(m_workers[index]);
+    }
+
+    void detach() {
+        iterative_teardown::set_sink(nullptr);
+    }
+
+    // Runs tasks as worker `index` until the whole graph is destroyed.
+    void work(size_t index) {
+        attach(index);
+        while (m_outstanding.load(std::memory_order_acquire) > 0) {
+            DeferredNode *node = next_task(index);
+            if (!node) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            node->destroy_object();
+            m_outstanding.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        detach();
+    }
+};
+
+// Drops `root` and destroys the objects that only it kept alive on `threads`
+// threads, the calling one included. Objects with other owners only lose a
+// reference. The graph must use iterative_policy with a thread-safe Base.
+template <class T, class Base>
+void parallel_release(shared_ptr<T, iterative_policy<Base>> root,
+    size_t threads = std::thread::hardware_concurrency()) {
+    if (threads < 2) {
+        root.reset();
+        return;
+    }
+
+    ReleasePool pool(threads);
+    pool.attach(0);
+    root.reset();
+    pool.detach();
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; i++)
+        workers.emplace_back(&ReleasePool::work, &pool, i);
+
+    pool.work(0);
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+#endif // __PARALLEL_RELEASE_HPP__
@@ -0,0 +1,62 @@
+#ifndef __POINTER_STORAGE_HPP__
+#define __POINTER_STORAGE_HPP__
+
+#include <memory>
+#include <new>
+
+#include "compressed_member.hpp"
+#include "control_block.hpp"
+
+// Control block for an object that was allocated elsewhere and is handed over
+// as a raw pointer. The deleter and the allocator live inside the block, so a
+// stateful deleter costs no second allocation and stateless ones cost no space.
+// The block itself is allocated with Alloc rebound to PointerStorage.
+template <class T, class Deleter, class Alloc, class Policy = default_policy>
+class PointerStorage
+    : public ControlBlock<Policy>,
+      private CompressedMember<Deleter, 0>,
+      private CompressedMember<Alloc, 1> {
+private:
+    typedef CompressedMember<Deleter, 0> DeleterMember;
+    typedef CompressedMember<Alloc, 1> AllocMember;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<PointerStorage> BlockAlloc;
+    typedef std::allocator_traits<BlockAlloc> BlockTraits;
+
+    T *m_object;
+
+    PointerStorage(T *object, const Deleter &deleter, const Alloc &alloc)
+        : DeleterMember(deleter), AllocMember(alloc), m_object(object) {}
+
+    void dispose() override {
+        DeleterMember::get()(m_object);
+    }
+
+    void deallocate() override {
+        BlockAlloc alloc(AllocMember::get());
+        this->~PointerStorage();
+        BlockTraits::deallocate(alloc, this, 1);
+    }
+
+public:
+    // Takes ownership of `object`: if the block can not be created, the
+    // object is deleted before the exception leaves.
+    static PointerStorage *create(T *object, Deleter deleter, Alloc alloc) {
+        PointerStorage *block = nullptr;
+        try {
+            BlockAlloc block_alloc(alloc);
+            block = BlockTraits::allocate(block_alloc, 1);
+            new (block) PointerStorage(object, deleter, alloc);
+            return block;
+        } catch (...) {
+            if (block) {
+                BlockAlloc block_alloc(alloc);
+                BlockTraits::deallocate(block_alloc, block, 1);
+            }
+
+            deleter(object);
+            throw;
+        }
+    }
+};
+
+#endif // __POINTER_STORAGE_HPP__
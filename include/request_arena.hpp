@@ -0,0 +1,202 @@
+#ifndef __REQUEST_ARENA_HPP__
+#define __REQUEST_ARENA_HPP__
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "memory.hpp"
+
+// Monotonic arena for objects that all die at the end of a request.
+//
+// Allocation bumps a pointer through chunks taken from operator new, and a
+// free is a no-op, so the last release of an object only runs its destructor.
+// reset() gives the memory back at once and keeps the first chunk for the next
+// request. Allocation is not thread-safe, but blocks may be freed on any
+// thread.
+//
+// Debug builds count the blocks that are still allocated and assert in reset()
+// and in the destructor that none is left, as the memory of a shared_ptr or a
+// weak_ptr that outlives its arena is gone.
+class request_arena {
+private:
+    struct Chunk {
+        Chunk *m_next;
+        size_t m_size;
+    };
+
+    static const size_t header_size = (sizeof(Chunk) + alignof(std::max_align_t) - 1) &
+        ~(alignof(std::max_align_t) - 1);
+
+    size_t m_chunk_size;
+    Chunk *m_chunks;
+    char *m_position;
+    char *m_end;
+
+#ifndef NDEBUG
+    std::atomic<size_t> m_live{0};
+#endif
+
+    static char *begin(Chunk *chunk) {
+        return reinterpret_cast<char *>(chunk) + header_size;
+    }
+
+    static char *align(char *position, size_t alignment) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(position);
+        return reinterpret_cast<char *>((address + alignment - 1) & ~uintptr_t(alignment - 1));
+    }
+
+    void add_chunk(size_t size) {
+        Chunk *chunk = static_cast<Chunk *>(::operator new(header_size + size));
+        chunk->m_next = m_chunks;
+        chunk->m_size = size;
+        m_chunks = chunk;
+        m_position = begin(chunk);
+        m_end = m_position + size;
+    }
+
+    void release_chunks(Chunk *chunk) {
+        while (chunk) {
+            Chunk *next = chunk->m_next;
+            ::operator delete(chunk);
+            chunk = next;
+        }
+    }
+
+public:
+    explicit request_arena(size_t chunk_size = 64 * 1024)
+        : m_chunk_size(chunk_size), m_chunks(nullptr), m_position(nullptr), m_end(nullptr) {}
+
+    request_arena(const request_arena &) = delete;
+    request_arena &operator=(const request_arena &) = delete;
+
+    // `alignment` must be a power of two.
+    void *allocate(size_t size, size_t alignment) {
+        char *block = align(m_position, alignment);
+        if (!m_position || block + size > m_end) {
+            // A request larger than a chunk gets a chunk of its own.
+            size_t padding = alignment > alignof(std::max_align_t) ? alignment : 0;
+            add_chunk(size + padding > m_chunk_size ? size + padding : m_chunk_size);
+            block = align(m_position, alignment);
+        }
+
+        m_position = block + size;
+#ifndef NDEBUG
+        m_live.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return block;
+    }
+
+    void deallocate(void *, size_t) noexcept {
+#ifndef NDEBUG
+        m_live.fetch_sub(1, std::memory_order_relaxed);
+#endif
+    }
+
+    // Frees everything allocated since the last reset. The first chunk is
+    // kept, so a steady stream of requests allocates no memory.
+    void reset() {
+#ifndef NDEBUG
+        assert(m_live.load(std::memory_order_relaxed) == 0 && "a block outlived its request_arena");
+#endif
+        if (!m_chunks)
+            return;
+
+        Chunk *first = m_chunks;
+        while (first->m_next)
+            first = first->m_next;
+
+        Chunk *rest = m_chunks;
+        m_chunks = first;
+        for (Chunk *chunk = rest; chunk != first;) {
+            Chunk *next = chunk->m_next;
+            ::operator delete(chunk);
+            chunk = next;
+        }
+
+        if (first->m_size != m_chunk_size) {
+            release_chunks(first);
+            m_chunks = nullptr;
+            m_position = m_end = nullptr;
+            return;
+        }
+
+        m_position = begin(first);
+        m_end = m_position + first->m_size;
+    }
+
+    // Bytes taken from operator new, headers excluded.
+    size_t capacity() const {
+        size_t capacity = 0;
+        for (Chunk *chunk = m_chunks; chunk; chunk = chunk->m_next)
+            capacity += chunk->m_size;
+
+        return capacity;
+    }
+
+#ifndef NDEBUG
+    size_t live_blocks() const {
+        return m_live.load(std::memory_order_relaxed);
+    }
+#endif
+
+    ~request_arena() {
+#ifndef NDEBUG
+        assert(m_live.load(std::memory_order_relaxed) == 0 && "a block outlived its request_arena");
+#endif
+        release_chunks(m_chunks);
+    }
+};
+
+// Allocator that takes its memory from a request_arena.
+template <class T>
+class arena_allocator {
+private:
+    request_arena *m_arena;
+
+    template <class U>
+    friend class arena_allocator;
+
+    template <class U, class V>
+    friend bool operator==(const arena_allocator<U> &, const arena_allocator<V> &) noexcept;
+
+public:
+    typedef T value_type;
+
+    arena_allocator(request_arena &arena) noexcept : m_arena(&arena) {}
+
+    template <class U>
+    arena_allocator(const arena_allocator<U> &other) noexcept : m_arena(other.m_arena) {}
+
+    T *allocate(size_t count) {
+        if (count > SIZE_MAX / sizeof(T))
+            throw std::bad_array_new_length();
+
+        return static_cast<T *>(m_arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *pointer, size_t count) noexcept {
+        m_arena->deallocate(pointer, count * sizeof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const arena_allocator<T> &lhs, const arena_allocator<U> &rhs) noexcept {
+    return lhs.m_arena == rhs.m_arena;
+}
+
+template <class T, class U>
+bool operator!=(const arena_allocator<T> &lhs, const arena_allocator<U> &rhs) noexcept {
+    return !(lhs == rhs);
+}
+
+// As make_shared, but the control block is allocated in `arena`.
+template <class T, class Policy = default_policy, class... Args>
+SharedObject<T, Policy> make_shared_in(request_arena &arena, Args &&...args) {
+    return allocate_shared<T, Policy>(arena_allocator<T>(arena), std::forward<Args>(args)...);
+}
+
+#endif // __REQUEST_ARENA_HPP__
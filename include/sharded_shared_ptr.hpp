@@ -0,0 +1,215 @@
+#ifndef __SHARDED_SHARED_PTR_HPP__
+#define __SHARDED_SHARED_PTR_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "memory.hpp"
+
+// Control block of sharded_shared_ptr, modelled on the Linux percpu_ref.
+//
+// While the handle that created the block (the primary handle) is alive,
+// copies and releases only touch the calling thread's shard. A shard may go
+// negative because a reference can be released on another thread than the one
+// that took it. Nothing can reach zero in this mode, as the primary handle
+// holds the central count.
+//
+// Dropping the primary handle kills the shards: every shard is swapped with a
+// dead marker and its value is summed into the central count. Later operations
+// that find the dead marker go to the central count, and whoever takes it to
+// zero frees the block. A bias is kept on the central count while the shards
+// are summed, so it can not hit zero half-way.
+template <class T, class Policy, size_t Shards>
+class ShardedStorage {
+private:
+    static const size_t cache_line = 64;
+    static const int64_t dead = INT64_MIN / 2;
+    static const int64_t bias = int64_t(1) << 40;
+
+    // Shards are 64 bytes apart, so each one is on its own cache line even if
+    // the block is not cache-line aligned.
+    struct Shard {
+        std::atomic<int64_t> m_count{0};
+        char m_padding[cache_line - sizeof(std::atomic<int64_t>)];
+    };
+
+    static size_t shard_index() {
+        static std::atomic<size_t> next_index(0);
+        static thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed) % Shards;
+        return index;
+    }
+
+    static bool is_dead(int64_t count) {
+        return count < dead / 2;
+    }
+
+    Shard m_shards[Shards];
+    std::atomic<int64_t> m_central{1};
+    char m_padding[cache_line - sizeof(std::atomic<int64_t>)];
+
+    bool release_central(int64_t count) {
+        return m_central.fetch_sub(count, std::memory_order_acq_rel) == count;
+    }
+
+public:
+    shared_ptr<T, Policy> m_object;
+
+    explicit ShardedStorage(shared_ptr<T, Policy> &&object) : m_object(std::move(object)) {}
+
+    void add_shared() {
+        if (is_dead(m_shards[shard_index()].m_count.fetch_add(1, std::memory_order_relaxed)))
+            m_central.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release_shared() {
+        if (is_dead(m_shards[shard_index()].m_count.fetch_sub(1, std::memory_order_acq_rel)) &&
+            release_central(1))
+            delete this;
+    }
+
+    // Drops the primary reference and switches the block to the central count.
+    void kill() {
+        m_central.fetch_add(bias, std::memory_order_relaxed);
+
+        int64_t sum = 0;
+        for (size_t i = 0; i < Shards; i++)
+            sum += m_shards[i].m_count.exchange(dead, std::memory_order_acq_rel);
+
+        m_central.fetch_add(sum, std::memory_order_relaxed);
+        if (release_central(bias + 1))
+            delete this;
+    }
+
+    size_t use_count() const {
+        int64_t count = m_central.load(std::memory_order_relaxed);
+        if (count >= bias)
+            count -= bias;
+
+        for (size_t i = 0; i < Shards; i++) {
+            int64_t shard = m_shards[i].m_count.load(std::memory_order_relaxed);
+            if (!is_dead(shard))
+                count += shard;
+        }
+
+        return count > 0 ? size_t(count) : 0;
+    }
+};
+
+// Shared pointer for a few very hot objects, like a configuration snapshot,
+// that are copied from every core. Reference counts are spread over Shards
+// cache-line-padded per-thread counters, so copies on different cores do not
+// contend. The handle returned by make_sharded() is the primary one, and
+// dropping it switches the object to a single atomic count.
+template <class T, class Policy = atomic_policy, size_t Shards = 64>
+class sharded_shared_ptr {
+private:
+    typedef ShardedStorage<T, Policy, Shards> Block;
+
+    Block *m_block;
+    bool m_primary;
+
+    void copy(const sharded_shared_ptr &other) {
+        m_block = other.m_block;
+        m_primary = false;
+        if (m_block)
+            m_block->add_shared();
+    }
+
+    void destroy() {
+        if (m_block) {
+            if (m_primary)
+                m_block->kill();
+            else
+                m_block->release_shared();
+        }
+    }
+
+public:
+    sharded_shared_ptr() : m_block(nullptr), m_primary(false) {}
+
+    explicit sharded_shared_ptr(shared_ptr<T, Policy> object) : m_block(nullptr), m_primary(false) {
+        if (object) {
+            m_block = new Block(std::move(object));
+            m_primary = true;
+        }
+    }
+
+    sharded_shared_ptr(const sharded_shared_ptr &other) {
+        copy(other);
+    }
+
+    sharded_shared_ptr(sharded_shared_ptr &&other) noexcept
+        : m_block(other.m_block), m_primary(other.m_primary) {
+        other.m_block = nullptr;
+        other.m_primary = false;
+    }
+
+    sharded_shared_ptr &operator=(const sharded_shared_ptr &other) {
+        if (this != &other) {
+            destroy();
+            copy(other);
+        }
+
+        return *this;
+    }
+
+    sharded_shared_ptr &operator=(sharded_shared_ptr &&other) noexcept {
+        sharded_shared_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    void swap(sharded_shared_ptr &other) noexcept {
+        std::swap(m_block, other.m_block);
+        std::swap(m_primary, other.m_primary);
+    }
+
+    void reset() noexcept {
+        sharded_shared_ptr().swap(*this);
+    }
+
+    T &operator*() const {
+        if (m_block)
+            return *m_block->m_object;
+
+        throw std::runtime_error("sharded_shared_ptr has not object for dereferencing");
+    }
+
+    T *operator->() const {
+        return get();
+    }
+
+    operator bool() const {
+        return m_block ? true : false;
+    }
+
+    T *get() const {
+        return m_block ? m_block->m_object.get() : nullptr;
+    }
+
+    // Returns an ordinary shared_ptr to the same object.
+    shared_ptr<T, Policy> get_shared() const {
+        return m_block ? m_block->m_object : shared_ptr<T, Policy>();
+    }
+
+    // Sums all the shards, so it costs one load per shard.
+    size_t use_count() const {
+        return m_block ? m_block->use_count() : 0;
+    }
+
+    bool is_primary() const {
+        return m_primary;
+    }
+
+    ~sharded_shared_ptr() {
+        destroy();
+    }
+};
+
+template <class T, class Policy = atomic_policy, size_t Shards = 64, class... Args>
+sharded_shared_ptr<T, Policy, Shards> make_sharded(Args &&...args) {
+    return sharded_shared_ptr<T, Policy, Shards>(make_shared<T, Policy>(std::forward<Args>(args)...));
+}
+
+#endif // __SHARDED_SHARED_PTR_HPP__
@@ -0,0 +1,184 @@
+#ifndef __STATIC_POOL_HPP__
+#define __STATIC_POOL_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "memory.hpp"
+
+// Stateless allocator that hands out the slots of Pool. Every allocation is
+// one slot, so it only serves the control block of Pool::make_shared.
+template <class T, class Pool>
+class StaticPoolAllocator {
+public:
+    typedef T value_type;
+
+    StaticPoolAllocator() noexcept {}
+
+    template <class U>
+    StaticPoolAllocator(const StaticPoolAllocator<U, Pool> &) noexcept {}
+
+    T *allocate(size_t) {
+        static_assert(sizeof(T) <= Pool::slot_size && alignof(T) <= Pool::slot_alignment,
+            "a static_pool slot only holds its control block");
+        return static_cast<T *>(Pool::pop());
+    }
+
+    void deallocate(T *pointer, size_t) noexcept {
+        Pool::push(pointer);
+    }
+};
+
+template <class T, class U, class Pool>
+bool operator==(const StaticPoolAllocator<T, Pool> &, const StaticPoolAllocator<U, Pool> &) noexcept {
+    return true;
+}
+
+template <class T, class U, class Pool>
+bool operator!=(const StaticPoolAllocator<T, Pool> &, const StaticPoolAllocator<U, Pool> &) noexcept {
+    return false;
+}
+
+// Static pool of Capacity control blocks for T, for threads that must not call
+// malloc once they run, such as audio or market-data threads.
+//
+// The slots are a static array, so the pool needs no initialization and no
+// heap. Free slots are kept on a lock-free stack of slot indices: the head is
+// one 64-bit word with the index of the top slot and a tag that every change
+// increments, so a CAS can not succeed on a head that was popped and pushed
+// back in between (ABA). Slots that were never used are handed out from a
+// bump counter before that.
+//
+// make_shared() first reserves a slot with a count of available slots, so the
+// allocation itself can not fail. When the pool is full it returns an empty
+// shared_ptr and calls the handler set by set_full_handler(). A slot goes back
+// to the pool when the object has no shared_ptr and no weak_ptr left.
+//
+// Pools with the same T, Capacity and Policy share their slots, Tag tells them
+// apart.
+template <class T, size_t Capacity, class Policy = default_policy, class Tag = void>
+class static_pool {
+private:
+    typedef StaticPoolAllocator<T, static_pool> Allocator;
+    typedef AllocatedStorage<T, Allocator, Policy> Block;
+
+    static const uint64_t index_mask = 0xffffffff;
+    static const int tag_shift = 32;
+
+    static_assert(Capacity > 0 && Capacity < index_mask, "static_pool capacity is out of range");
+
+    struct Slot {
+        alignas(Block) unsigned char m_bytes[sizeof(Block)];
+    };
+
+    static Slot s_slots[Capacity];
+    static std::atomic<uint32_t> s_next[Capacity];
+    // Index + 1 of the top free slot in the low half, 0 if there is none.
+    static std::atomic<uint64_t> s_head;
+    static std::atomic<size_t> s_unused;
+    static std::atomic<size_t> s_available;
+    static std::atomic<void (*)()> s_on_full;
+
+    static uint64_t next_head(uint64_t head, uint64_t index) {
+        return (((head >> tag_shift) + 1) << tag_shift) | index;
+    }
+
+    static bool reserve() {
+        size_t available = s_available.load(std::memory_order_relaxed);
+        do {
+            if (!available)
+                return false;
+        } while (!s_available.compare_exchange_weak(available, available - 1,
+            std::memory_order_acquire, std::memory_order_relaxed));
+
+        return true;
+    }
+
+    // Only called with a reservation, so a slot is free or about to be.
+    static void *pop() {
+        for (;;) {
+            uint64_t head = s_head.load(std::memory_order_acquire);
+            while (head & index_mask) {
+                uint32_t index = uint32_t(head & index_mask) - 1;
+                uint64_t next = next_head(head, s_next[index].load(std::memory_order_relaxed));
+                if (s_head.compare_exchange_weak(head, next,
+                    std::memory_order_acquire, std::memory_order_acquire))
+                    return &s_slots[index];
+            }
+
+            size_t unused = s_unused.load(std::memory_order_relaxed);
+            while (unused < Capacity) {
+                if (s_unused.compare_exchange_weak(unused, unused + 1,
+                    std::memory_order_relaxed, std::memory_order_relaxed))
+                    return &s_slots[unused];
+            }
+        }
+    }
+
+    static void push(void *pointer) {
+        uint64_t index = static_cast<Slot *>(pointer) - s_slots;
+        uint64_t head = s_head.load(std::memory_order_relaxed);
+        do {
+            s_next[index].store(uint32_t(head & index_mask), std::memory_order_relaxed);
+        } while (!s_head.compare_exchange_weak(head, next_head(head, index + 1),
+            std::memory_order_release, std::memory_order_relaxed));
+
+        s_available.fetch_add(1, std::memory_order_release);
+    }
+
+    template <class U, class Pool>
+    friend class StaticPoolAllocator;
+
+public:
+    static const size_t slot_size = sizeof(Block);
+    static const size_t slot_alignment = alignof(Block);
+
+    // Returns an empty shared_ptr if all slots are in use.
+    template <class... Args>
+    static shared_ptr<T, Policy> make_shared(Args &&...args) {
+        if (!reserve()) {
+            void (*on_full)() = s_on_full.load(std::memory_order_acquire);
+            if (on_full)
+                on_full();
+
+            return shared_ptr<T, Policy>();
+        }
+
+        return allocate_shared<T, Policy>(Allocator(), std::forward<Args>(args)...);
+    }
+
+    // `handler` runs on the thread whose make_shared() found the pool full.
+    static void set_full_handler(void (*handler)()) {
+        s_on_full.store(handler, std::memory_order_release);
+    }
+
+    static size_t available() {
+        return s_available.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity() {
+        return Capacity;
+    }
+};
+
+template <class T, size_t Capacity, class Policy, class Tag>
+typename static_pool<T, Capacity, Policy, Tag>::Slot static_pool<T, Capacity, Policy, Tag>::s_slots[Capacity];
+
+template <class T, size_t Capacity, class Policy, class Tag>
+std::atomic<uint32_t> static_pool<T, Capacity, Policy, Tag>::s_next[Capacity];
+
+template <class T, size_t Capacity, class Policy, class Tag>
+std::atomic<uint64_t> static_pool<T, Capacity, Policy, Tag>::s_head{0};
+
+template <class T, size_t Capacity, class Policy, class Tag>
+std::atomic<size_t> static_pool<T, Capacity, Policy, Tag>::s_unused{0};
+
+template <class T, size_t Capacity, class Policy, class Tag>
+std::atomic<size_t> static_pool<T, Capacity, Policy, Tag>::s_available{Capacity};
+
+template <class T, size_t Capacity, class Policy, class Tag>
+std::atomic<void (*)()> static_pool<T, Capacity, Policy, Tag>::s_on_full{nullptr};
+
+#endif // __STATIC_POOL_HPP__
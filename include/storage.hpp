@@ -1,19 +1,71 @@
 #ifndef __STORAGE_HPP__
 #define __STORAGE_HPP__
 
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 #include "aligned_storage.hpp"
+#include "control_block.hpp"
 
+// Blocks of trivially destructible objects that plain operator new can place
+// need no virtual functions, see BlockPointer.
 template <class T>
-class Storage {
+struct IsInlineBlock {
+    static const bool value = std::is_trivially_destructible<T>::value &&
+        alignof(T) <= alignof(std::max_align_t);
+};
+
+// Control block that holds the object inline, as created by make_shared.
+template <class T, class Policy = default_policy, bool Inline = IsInlineBlock<T>::value>
+class Storage : public ControlBlock<Policy> {
 public:
     AlignedStorage<T> m_storage;
-    size_t m_shared_count = 0;
-    size_t m_weak_count = 0;
 
-    Storage(const T &object) {
-        new (m_storage.begin()) T(object);
-        m_shared_count++;
+    template <class... Args>
+    explicit Storage(Args &&...args) {
+        new (m_storage.begin()) T(std::forward<Args>(args)...);
+    }
+
+private:
+    void dispose() override {
+        m_storage.begin()->~T();
+    }
+
+    void deallocate() override {
+        delete this;
+    }
+};
+
+// The same block without a vtable, so it is as small as the counts and the
+// object.
+template <class T, class Policy>
+class Storage<T, Policy, true> : public BlockCounts<Policy> {
+public:
+    AlignedStorage<T> m_storage;
+
+    template <class... Args>
+    explicit Storage(Args &&...args) {
+        new (m_storage.begin()) T(std::forward<Args>(args)...);
+        bind_policy(this->m_counts, this);
+    }
+
+    void release_shared() {
+        if (this->m_counts.release_shared())
+            destroy_object();
+    }
+
+    // The object needs no destructor, so only the weak reference of the
+    // shared owners is dropped.
+    void destroy_object() {
+        release_weak();
+    }
+
+    void release_weak() {
+        if (this->m_counts.release_weak())
+            delete this;
     }
 };
 
-#endif // __STORAGE_HPP__
\ No newline at end of file
+#endif // __STORAGE_HPP__
@@ -0,0 +1,106 @@
+#ifndef __THREAD_MAILBOX_HPP__
+#define __THREAD_MAILBOX_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Calls Handle on every node of a stack linked through Next, oldest first,
+// and returns how many there were. Handle may free the node.
+template <class Node, Node *Node::*Next, void (Node::*Handle)()>
+size_t drain_oldest_first(Node *newest) {
+    Node *oldest = nullptr;
+    while (newest) {
+        Node *next = newest->*Next;
+        newest->*Next = oldest;
+        oldest = newest;
+        newest = next;
+    }
+
+    size_t count = 0;
+    while (oldest) {
+        Node *next = oldest->*Next;
+        (oldest->*Handle)();
+        oldest = next;
+        count++;
+    }
+
+    return count;
+}
+
+// Mailbox of one thread. Other threads push nodes onto a lock-free MPSC stack
+// linked through Next, and the owner thread runs Handle on them in drain().
+// The mailbox is reference counted by the objects that may post to it, so it
+// outlives the thread: when the thread exits the nodes still queued are
+// handled, the mailbox is closed and push() fails from then on.
+template <class Node, Node *Node::*Next, void (Node::*Handle)()>
+class ThreadMailbox {
+private:
+    std::atomic<size_t> m_refs{1};
+    std::atomic<Node *> m_head{nullptr};
+
+    static Node *closed() {
+        return reinterpret_cast<Node *>(uintptr_t(1));
+    }
+
+    static size_t handle_all(Node *newest) {
+        return drain_oldest_first<Node, Next, Handle>(newest);
+    }
+
+    void close() {
+        handle_all(m_head.exchange(closed(), std::memory_order_acq_rel));
+    }
+
+    class CurrentThread {
+    public:
+        ThreadMailbox *m_mailbox = new ThreadMailbox();
+
+        ~CurrentThread() {
+            ThreadMailbox *mailbox = m_mailbox;
+            m_mailbox = nullptr;
+            mailbox->close();
+            mailbox->release();
+        }
+    };
+
+public:
+    // Returns null while the calling thread is exiting.
+    static ThreadMailbox *current() {
+        static thread_local CurrentThread thread;
+        return thread.m_mailbox;
+    }
+
+    void add_ref() {
+        m_refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() {
+        if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    bool has_pending() const {
+        return m_head.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    // Returns false if the owner has already exited.
+    bool push(Node *node) {
+        Node *head = m_head.load(std::memory_order_acquire);
+        do {
+            if (head == closed())
+                return false;
+
+            node->*Next = head;
+        } while (!m_head.compare_exchange_weak(head, node,
+            std::memory_order_release, std::memory_order_acquire));
+
+        return true;
+    }
+
+    // Owner only.
+    size_t drain() {
+        return handle_all(m_head.exchange(nullptr, std::memory_order_acquire));
+    }
+};
+
+#endif // __THREAD_MAILBOX_HPP__
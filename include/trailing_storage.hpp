@@ -0,0 +1,144 @@
+#ifndef __TRAILING_STORAGE_HPP__
+#define __TRAILING_STORAGE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "aligned_storage.hpp"
+#include "control_block.hpp"
+
+// View of a contiguous run of elements.
+template <class T>
+class span {
+private:
+    T *m_data;
+    size_t m_size;
+
+public:
+    span() : m_data(nullptr), m_size(0) {}
+
+    span(T *data, size_t size) : m_data(data), m_size(size) {}
+
+    T *data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    T &operator[](size_t index) const {
+        return m_data[index];
+    }
+
+    T *begin() const {
+        return m_data;
+    }
+
+    T *end() const {
+        return m_data + m_size;
+    }
+};
+
+// Part of the control block of make_shared_with_trailing that does not depend
+// on the header type, so the tail can be found from any pointer that shares
+// the block, aliases included.
+template <class U, class Policy = default_policy>
+class TrailingBlock : public ControlBlock<Policy> {
+protected:
+    U *m_tail;
+    size_t m_size;
+
+    explicit TrailingBlock(size_t size) : m_tail(nullptr), m_size(size) {}
+
+public:
+    span<U> tail() const {
+        return span<U>(m_tail, m_size);
+    }
+};
+
+// Control block of make_shared_with_trailing: the counts, the header object T
+// and `size` value-initialized elements of U are one allocation, in that order.
+template <class T, class U, class Policy = default_policy>
+class TrailingStorage : public TrailingBlock<U, Policy> {
+private:
+    static const size_t padding = alignof(U) > 1 ? alignof(U) - 1 : 0;
+
+    explicit TrailingStorage(size_t size) : TrailingBlock<U, Policy>(size) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(this + 1);
+        this->m_tail = reinterpret_cast<U *>((address + alignof(U) - 1) & ~uintptr_t(alignof(U) - 1));
+    }
+
+    void destroy_tail(size_t count) {
+        while (count > 0)
+            this->m_tail[--count].~U();
+    }
+
+    void dispose() override {
+        destroy_tail(this->m_size);
+        m_storage.begin()->~T();
+    }
+
+    void deallocate() override {
+        this->~TrailingStorage();
+        free_memory(this);
+    }
+
+    // With aligned new, AlignedStorage<T> is a plain alignas buffer, so an
+    // over-aligned header needs an allocation with the block's alignment.
+    static void *allocate_memory(size_t bytes) {
+#if defined(__cpp_aligned_new)
+        if (alignof(TrailingStorage) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            return ::operator new(bytes, std::align_val_t(alignof(TrailingStorage)));
+#endif
+        return ::operator new(bytes);
+    }
+
+    static void free_memory(void *memory) {
+#if defined(__cpp_aligned_new)
+        if (alignof(TrailingStorage) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(memory, std::align_val_t(alignof(TrailingStorage)));
+            return;
+        }
+#endif
+        ::operator delete(memory);
+    }
+
+public:
+    AlignedStorage<T> m_storage;
+
+    template <class... Args>
+    static TrailingStorage *create(size_t size, Args &&...args) {
+        if (size > (SIZE_MAX - sizeof(TrailingStorage) - padding) / sizeof(U))
+            throw std::bad_array_new_length();
+
+        void *memory = allocate_memory(sizeof(TrailingStorage) + padding + size * sizeof(U));
+        TrailingStorage *block = new (memory) TrailingStorage(size);
+        bool header = false;
+        size_t constructed = 0;
+        try {
+            new (block->m_storage.begin()) T(std::forward<Args>(args)...);
+            header = true;
+            for (; constructed < size; constructed++)
+                new (block->m_tail + constructed) U();
+        } catch (...) {
+            block->destroy_tail(constructed);
+            if (header)
+                block->m_storage.begin()->~T();
+
+            block->~TrailingStorage();
+            free_memory(memory);
+            throw;
+        }
+
+        return block;
+    }
+};
+
+#endif // __TRAILING_STORAGE_HPP__
@@ -0,0 +1,94 @@
+#include "catch_amalgamated.hpp"
+#include "../include/memory.hpp"
+#include "../include/static_pool.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions of this binary only, so that the
+// other tests keep the library's own. Allocations are counted while
+// `counting` is set.
+
+namespace {
+    std::atomic<bool> counting(false);
+    std::atomic<size_t> operator_new_calls(0);
+
+    void *allocate(size_t size) {
+        if (counting.load(std::memory_order_relaxed))
+            operator_new_calls.fetch_add(1, std::memory_order_relaxed);
+
+        return std::malloc(size ? size : 1);
+    }
+
+    struct SmallPool {};
+
+    const int iterations = 10000;
+}
+
+void *operator new(size_t size) {
+    if (void *memory = allocate(size))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    if (void *memory = allocate(size))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+    std::free(memory);
+}
+
+TEST_CASE("Test static_pool makes no operator new calls") {
+    typedef static_pool<std::array<int, 4>, 4, atomic_policy, SmallPool> Pool;
+
+    int sum = 0;
+    counting = true;
+    for (int i = 0; i < iterations; i++) {
+        shared_ptr<std::array<int, 4>> ptr = Pool::make_shared();
+        (*ptr)[0] = i;
+        shared_ptr<std::array<int, 4>> copy(ptr);
+        weak_ptr<std::array<int, 4>> w_ptr(ptr);
+        ptr.reset();
+        sum += (*w_ptr.lock())[0] == i;
+    }
+    counting = false;
+
+    REQUIRE(operator_new_calls == 0);
+    REQUIRE(sum == iterations);
+    REQUIRE(Pool::available() == 4);
+}
@@ -0,0 +1,603 @@
+#include "catch_amalgamated.hpp"
+#include "../include/memory.hpp"
+#include "../include/atomic_shared_ptr.hpp"
+#include "../include/biased_policy.hpp"
+#include "../include/block_pool.hpp"
+#include "../include/deferred_policy.hpp"
+#include "../include/intrusive_ptr.hpp"
+#include "../include/parallel_release.hpp"
+#include "../include/request_arena.hpp"
+#include "../include/sharded_shared_ptr.hpp"
+#include "../include/static_pool.hpp"
+#include "counting_policy.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////// shared_ptr move benchmarks ///////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    typedef CountingPolicy<default_policy> counting_policy;
+    typedef shared_ptr<int, counting_policy> counted_int;
+    typedef shared_ptr<std::string, counting_policy> counted_string;
+
+    counted_string hand_off(counted_string ptr) {
+        return ptr;
+    }
+
+    std::vector<counted_int> grow(size_t count) {
+        std::vector<counted_int> ptrs;
+        for (size_t i = 0; i < count; i++)
+            ptrs.push_back(counted_int(static_cast<int>(i)));
+        return ptrs;
+    }
+
+    void hand_off_by_move(counted_string &ptr, size_t count) {
+        std::queue<counted_string> queue;
+        for (size_t i = 0; i < count; i++) {
+            queue.push(std::move(ptr));
+            ptr = hand_off(std::move(queue.front()));
+            queue.pop();
+        }
+    }
+}
+
+TEST_CASE("Benchmark shared_ptr relocation and hand-off") {
+    const size_t count = 10000;
+
+    BENCHMARK("std::vector<shared_ptr> growth") {
+        return grow(count).size();
+    };
+
+    // relocated elements are moved: no count is added or released
+    counting_policy::adds = counting_policy::releases = 0;
+    std::vector<counted_int> ptrs = grow(count);
+    REQUIRE(counting_policy::adds == 0);
+    REQUIRE(counting_policy::releases == 0);
+
+    counted_string ptr(std::string("hello world"));
+
+    BENCHMARK("hand-off by copy") {
+        std::queue<counted_string> queue;
+        for (size_t i = 0; i < count; i++) {
+            queue.push(ptr);
+            counted_string taken = hand_off(queue.front());
+            queue.pop();
+        }
+        return ptr.use_count();
+    };
+
+    BENCHMARK("hand-off by move") {
+        hand_off_by_move(ptr, count);
+        return ptr.use_count();
+    };
+
+    counting_policy::adds = counting_policy::releases = 0;
+    hand_off_by_move(ptr, count);
+    REQUIRE(counting_policy::adds == 0);
+    REQUIRE(counting_policy::releases == 0);
+    REQUIRE(ptr.use_count() == 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////// atomic_shared_ptr contention benchmarks /////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    class MutexSlot {
+    private:
+        mutable std::mutex m_mutex;
+        shared_ptr<std::vector<int>> m_ptr;
+
+    public:
+        shared_ptr<std::vector<int>> load() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_ptr;
+        }
+
+        void store(shared_ptr<std::vector<int>> ptr) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ptr = std::move(ptr);
+        }
+    };
+
+    size_t max_threads() {
+        return std::max(2u, std::thread::hardware_concurrency());
+    }
+
+    // `readers` threads load the slot while one writer keeps publishing new
+    // tables, like a routing table that is replaced under traffic.
+    template <class Slot>
+    size_t read_under_contention(Slot &slot, size_t readers, size_t loads) {
+        std::atomic<bool> done(false);
+        std::thread writer([&slot, &done]() {
+            while (!done) {
+                slot.store(make_shared<std::vector<int>>(16, 1));
+                std::this_thread::yield();
+            }
+        });
+
+        std::atomic<size_t> sum(0);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < readers; i++) {
+            threads.emplace_back([&slot, &sum, loads]() {
+                size_t local = 0;
+                for (size_t j = 0; j < loads; j++)
+                    local += slot.load()->size();
+                sum += local;
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        done = true;
+        writer.join();
+        return sum;
+    }
+}
+
+TEST_CASE("Benchmark atomic_shared_ptr against a mutex-protected slot") {
+    const size_t loads = 20000;
+
+    for (size_t readers = 1; readers <= max_threads(); readers *= 2) {
+        MutexSlot mutex_slot;
+        mutex_slot.store(make_shared<std::vector<int>>(16, 1));
+        BENCHMARK("mutex slot, " + std::to_string(readers) + " readers") {
+            return read_under_contention(mutex_slot, readers, loads);
+        };
+
+        atomic_shared_ptr<std::vector<int>> atomic_slot(make_shared<std::vector<int>>(16, 1));
+        BENCHMARK("atomic_shared_ptr, " + std::to_string(readers) + " readers") {
+            return read_under_contention(atomic_slot, readers, loads);
+        };
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////// biased_policy against atomic_policy /////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    template <class Policy>
+    size_t copy_on_owner(const shared_ptr<int, Policy> &ptr, size_t copies) {
+        size_t sum = 0;
+        for (size_t i = 0; i < copies; i++) {
+            shared_ptr<int, Policy> copy(ptr);
+            sum += copy.use_count();
+        }
+        return sum;
+    }
+
+    // The owner keeps copying while `others` threads copy the same object
+    // `shared_copies` times each.
+    template <class Policy>
+    size_t copy_mixed(const shared_ptr<int, Policy> &ptr, size_t copies,
+        size_t others, size_t shared_copies) {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < others; i++) {
+            threads.emplace_back([&ptr, shared_copies]() {
+                copy_on_owner(ptr, shared_copies);
+            });
+        }
+
+        size_t sum = copy_on_owner(ptr, copies);
+        for (std::thread &thread : threads)
+            thread.join();
+
+        biased_policy::merge_pending();
+        return sum;
+    }
+}
+
+TEST_CASE("Benchmark biased_policy against atomic_policy") {
+    const size_t copies = 100000;
+
+    shared_ptr<int, atomic_policy> atomic_ptr = make_shared<int, atomic_policy>(5);
+    shared_ptr<int, biased_policy> biased_ptr = make_shared<int, biased_policy>(5);
+
+    BENCHMARK("atomic_policy, owner thread only") {
+        return copy_on_owner(atomic_ptr, copies);
+    };
+
+    BENCHMARK("biased_policy, owner thread only") {
+        return copy_on_owner(biased_ptr, copies);
+    };
+
+    BENCHMARK("atomic_policy, mostly owner thread") {
+        return copy_mixed(atomic_ptr, copies, 1, copies / 100);
+    };
+
+    BENCHMARK("biased_policy, mostly owner thread") {
+        return copy_mixed(biased_ptr, copies, 1, copies / 100);
+    };
+
+    BENCHMARK("atomic_policy, evenly mixed") {
+        return copy_mixed(atomic_ptr, copies, max_threads() - 1, copies);
+    };
+
+    BENCHMARK("biased_policy, evenly mixed") {
+        return copy_mixed(biased_ptr, copies, max_threads() - 1, copies);
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////// sharded_shared_ptr scaling ////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    // Every thread copies and drops the same hot pointer `copies` times.
+    template <class Ptr>
+    size_t copy_from_threads(const Ptr &ptr, size_t threads_count, size_t copies) {
+        std::atomic<size_t> sum(0);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < threads_count; i++) {
+            threads.emplace_back([&ptr, &sum, copies]() {
+                size_t local = 0;
+                for (size_t j = 0; j < copies; j++) {
+                    Ptr copy(ptr);
+                    local += copy ? 1 : 0;
+                }
+                sum += local;
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        return sum;
+    }
+}
+
+TEST_CASE("Benchmark sharded_shared_ptr scaling with threads") {
+    const size_t copies = 100000;
+
+    shared_ptr<int, atomic_policy> ptr = make_shared<int, atomic_policy>(5);
+    sharded_shared_ptr<int> sharded_ptr = make_sharded<int>(5);
+
+    for (size_t threads = 1; threads <= max_threads(); threads *= 2) {
+        BENCHMARK("shared_ptr, " + std::to_string(threads) + " threads") {
+            return copy_from_threads(ptr, threads, copies);
+        };
+
+        BENCHMARK("sharded_shared_ptr, " + std::to_string(threads) + " threads") {
+            return copy_from_threads(sharded_ptr, threads, copies);
+        };
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////////// control block footprint //////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    template <class T>
+    void report_footprint(const char *name) {
+        std::printf("%-20s %14zu %14zu %14zu %14zu\n", name,
+            sizeof(Storage<T, single_thread_policy>),
+            sizeof(Storage<T, compact_single_thread_policy>),
+            sizeof(Storage<T, atomic_policy>),
+            sizeof(Storage<T, compact_atomic_policy>));
+    }
+}
+
+TEST_CASE("Report control block footprint") {
+    std::printf("%-20s %14s %14s %14s %14s\n", "T",
+        "single_thread", "compact", "atomic", "compact_atomic");
+    report_footprint<char>("char");
+    report_footprint<int>("int");
+    report_footprint<double>("double");
+    report_footprint<void *>("void *");
+    report_footprint<std::string>("std::string");
+    report_footprint<std::vector<int>>("std::vector<int>");
+
+    REQUIRE(sizeof(Storage<int, compact_atomic_policy>) < sizeof(Storage<int, atomic_policy>));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////// dereference cost ////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Benchmark shared_ptr dereference") {
+    const size_t count = 10000;
+
+    std::vector<shared_ptr<int>> ptrs;
+    std::vector<int *> raw_ptrs;
+    for (size_t i = 0; i < count; i++) {
+        ptrs.push_back(make_shared<int>(static_cast<int>(i)));
+        raw_ptrs.push_back(ptrs.back().get());
+    }
+
+    BENCHMARK("raw pointer dereference") {
+        long sum = 0;
+        for (int *ptr : raw_ptrs)
+            sum += *ptr;
+        return sum;
+    };
+
+    BENCHMARK("shared_ptr dereference") {
+        long sum = 0;
+        for (const shared_ptr<int> &ptr : ptrs)
+            sum += *ptr;
+        return sum;
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////// shared numeric buffers ////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Benchmark shared_ptr<T[]> against shared_ptr<std::vector>") {
+    const size_t count = 4096;
+
+    BENCHMARK("shared_ptr<std::vector<float>>") {
+        shared_ptr<std::vector<float>> buffer = make_shared<std::vector<float>>(count);
+        float sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += (*buffer)[i];
+        return sum;
+    };
+
+    BENCHMARK("make_shared<float[]>") {
+        shared_ptr<float[]> buffer = make_shared<float[]>(count);
+        float sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += buffer[i];
+        return sum;
+    };
+
+    BENCHMARK("make_shared_for_overwrite<float[]> aligned to 64") {
+        shared_ptr<float[]> buffer = make_shared_for_overwrite<float[]>(count, aligned_to<64>());
+        for (size_t i = 0; i < count; i++)
+            buffer[i] = 1;
+        return buffer[count - 1];
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////// intrusive_ptr against shared_ptr ///////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    struct CountedNode : intrusive_ref_counter<CountedNode> {
+        long value = 1;
+    };
+
+    struct PlainNode {
+        long value = 1;
+    };
+}
+
+TEST_CASE("Benchmark intrusive_ptr against shared_ptr") {
+    const size_t count = 10000;
+
+    BENCHMARK("make_shared and copy") {
+        shared_ptr<PlainNode> node = make_shared<PlainNode>();
+        long sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            shared_ptr<PlainNode> copy(node);
+            sum += copy->value;
+        }
+        return sum;
+    };
+
+    BENCHMARK("make_intrusive and copy") {
+        intrusive_ptr<CountedNode> node = make_intrusive<CountedNode>();
+        long sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            intrusive_ptr<CountedNode> copy(node);
+            sum += copy->value;
+        }
+        return sum;
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////// deferred destruction ///////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    // Returns the slowest of `rounds` last releases of a 4 MB object, in
+    // microseconds, as seen by the releasing thread.
+    template <class Policy>
+    double slowest_release(int rounds) {
+        double slowest = 0;
+        for (int i = 0; i < rounds; i++) {
+            shared_ptr<std::vector<int>, Policy> object = make_shared<std::vector<int>, Policy>(1 << 20, i);
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            object.reset();
+            std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+            slowest = std::max(slowest, elapsed.count());
+            deferred_reclaimer::drain();
+        }
+
+        return slowest;
+    }
+}
+
+TEST_CASE("Report the last release of a large object") {
+    std::printf("%-24s %14s\n", "destruction", "slowest (us)");
+    std::printf("%-24s %14.1f\n", "inline", slowest_release<atomic_policy>(50));
+    std::printf("%-24s %14.1f\n", "deferred", slowest_release<deferred_policy<>>(50));
+    REQUIRE(deferred_reclaimer::pending() == 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////// parallel teardown ///////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    struct GraphNode {
+        shared_ptr<GraphNode, iterative_policy<>> left;
+        shared_ptr<GraphNode, iterative_policy<>> right;
+        std::vector<int> payload = std::vector<int>(8);
+    };
+
+    shared_ptr<GraphNode, iterative_policy<>> make_graph(int depth) {
+        shared_ptr<GraphNode, iterative_policy<>> node = make_shared<GraphNode, iterative_policy<>>();
+        if (depth > 1) {
+            node->left = make_graph(depth - 1);
+            node->right = make_graph(depth - 1);
+        }
+
+        return node;
+    }
+}
+
+// Destroys a binary tree of 2^20 nodes. Scaling only shows on a machine with
+// as many free cores as threads.
+TEST_CASE("Report parallel_release scaling with threads") {
+    std::printf("%-10s %14s\n", "threads", "teardown (ms)");
+    for (size_t threads = 1; threads <= max_threads(); threads *= 2) {
+        shared_ptr<GraphNode, iterative_policy<>> root = make_graph(20);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        parallel_release(std::move(root), threads);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::printf("%-10zu %14.1f\n", threads, elapsed.count());
+    }
+
+    REQUIRE(iterative_teardown::pending() == 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////// pooled control blocks ////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    struct Request {
+        int id;
+        double payload[4];
+
+        explicit Request(int id) : id(id), payload() {}
+    };
+
+    // Every thread keeps a window of 64 live objects and replaces the oldest
+    // one `count` times, like request-scoped objects under load.
+    template <class Create>
+    size_t churn_from_threads(Create create, size_t threads, size_t count) {
+        std::atomic<size_t> sum(0);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([&sum, create, count]() {
+                std::vector<shared_ptr<Request>> window(64);
+                size_t local = 0;
+                for (size_t j = 0; j < count; j++) {
+                    window[j % window.size()] = create(int(j));
+                    local += window[j % window.size()]->id;
+                }
+                sum += local;
+            });
+        }
+
+        for (std::thread &worker : workers)
+            worker.join();
+
+        return sum;
+    }
+}
+
+TEST_CASE("Benchmark make_pooled against make_shared") {
+    const size_t count = 100000;
+
+    for (size_t threads = 1; threads <= max_threads(); threads *= 2) {
+        BENCHMARK("make_shared, " + std::to_string(threads) + " threads") {
+            return churn_from_threads([](int id) { return make_shared<Request>(id); }, threads, count);
+        };
+
+        BENCHMARK("make_pooled, " + std::to_string(threads) + " threads") {
+            return churn_from_threads([](int id) { return make_pooled<Request>(id); }, threads, count);
+        };
+    }
+}
+
+// A request creates 64 objects and drops them all when it ends.
+TEST_CASE("Benchmark make_shared_in against make_shared") {
+    const int requests = 1000;
+
+    BENCHMARK("make_shared") {
+        size_t sum = 0;
+        for (int i = 0; i < requests; i++) {
+            std::vector<shared_ptr<Request>> objects;
+            objects.reserve(64);
+            for (int j = 0; j < 64; j++)
+                objects.push_back(make_shared<Request>(j));
+            sum += objects.back()->id;
+        }
+        return sum;
+    };
+
+    request_arena arena;
+    BENCHMARK("make_shared_in") {
+        size_t sum = 0;
+        for (int i = 0; i < requests; i++) {
+            {
+                std::vector<shared_ptr<Request>> objects;
+                objects.reserve(64);
+                for (int j = 0; j < 64; j++)
+                    objects.push_back(make_shared_in<Request>(arena, j));
+                sum += objects.back()->id;
+            }
+            arena.reset();
+        }
+        return sum;
+    };
+}
+
+// static_pool pays four atomic operations per object to stay lock-free and
+// heap-free, so it trades some throughput for a bounded path with no malloc.
+TEST_CASE("Benchmark static_pool against make_shared") {
+    typedef static_pool<Request, 128> Pool;
+    const size_t count = 100000;
+
+    BENCHMARK("make_shared") {
+        return churn_from_threads([](int id) { return make_shared<Request>(id); }, 1, count);
+    };
+
+    BENCHMARK("make_pooled") {
+        return churn_from_threads([](int id) { return make_pooled<Request>(id); }, 1, count);
+    };
+
+    BENCHMARK("static_pool") {
+        return churn_from_threads([](int id) { return Pool::make_shared(id); }, 1, count);
+    };
+}
+
+// A spike of pooled objects that are all released again: the slabs stay
+// mapped until trim() gives them back.
+TEST_CASE("Report block_pool footprint after a spike") {
+    const size_t size = sizeof(AllocatedStorage<Request, pool_allocator<Request>>);
+
+    std::vector<shared_ptr<Request>> objects;
+    for (int i = 0; i < 200000; i++)
+        objects.push_back(make_pooled<Request>(i));
+
+    block_pool::size_class_stats spike = block_pool::stats(size);
+    objects.clear();
+    block_pool::size_class_stats released = block_pool::stats(size);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t bytes = block_pool::trim();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    block_pool::size_class_stats trimmed = block_pool::stats(size);
+
+    std::printf("%-16s %10s %12s %12s\n", "", "slabs", "blocks out", "high water");
+    std::printf("%-16s %10zu %12zu %12zu\n", "spike", spike.slabs, spike.blocks_out, spike.high_water);
+    std::printf("%-16s %10zu %12zu %12zu\n", "released", released.slabs, released.blocks_out, released.high_water);
+    std::printf("%-16s %10zu %12zu %12zu\n", "trimmed", trimmed.slabs, trimmed.blocks_out, trimmed.high_water);
+    std::printf("trim() returned %zu KiB in %.2f ms\n", bytes / 1024, elapsed.count());
+
+    REQUIRE(trimmed.slabs < spike.slabs);
+}
@@ -0,0 +1,42 @@
+#ifndef __COUNTING_POLICY_HPP__
+#define __COUNTING_POLICY_HPP__
+
+#include <cstddef>
+
+// Counts like Base and records every change of a shared count, so the tests
+// and benchmarks can tell a move from a copy followed by a release. Each Base
+// has its own counters.
+template <class Base>
+class CountingPolicy : public Base {
+public:
+    static size_t adds;
+    static size_t releases;
+
+    void add_shared() {
+        adds++;
+        Base::add_shared();
+    }
+
+    void add_shared(size_t count) {
+        adds++;
+        Base::add_shared(count);
+    }
+
+    bool try_add_shared() {
+        adds++;
+        return Base::try_add_shared();
+    }
+
+    bool release_shared() {
+        releases++;
+        return Base::release_shared();
+    }
+};
+
+template <class Base>
+size_t CountingPolicy<Base>::adds = 0;
+
+template <class Base>
+size_t CountingPolicy<Base>::releases = 0;
+
+#endif // __COUNTING_POLICY_HPP__
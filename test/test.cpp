@@ -1,5 +1,31 @@
 #include "catch_amalgamated.hpp"
 #include "../include/memory.hpp"
+#include "../include/atomic_shared_ptr.hpp"
+#include "../include/biased_policy.hpp"
+#include "../include/block_pool.hpp"
+#include "../include/deferred_policy.hpp"
+#include "../include/intrusive_ptr.hpp"
+#include "../include/iterative_policy.hpp"
+#include "../include/owner_thread_policy.hpp"
+#include "../include/parallel_release.hpp"
+#include "../include/request_arena.hpp"
+#include "../include/sharded_shared_ptr.hpp"
+#include "../include/static_pool.hpp"
+#include "counting_policy.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 //////////////////////////// shared_ptr tests /////////////////////////////////
@@ -59,6 +85,32 @@ TEST_CASE("Test shared_ptr(const weak_ptr<T>&) constructor") {
     }
 }
 
+TEST_CASE("Test shared_ptr(const weak_ptr<T>&) constructor with expired weak_ptr") {
+    SECTION("Test shared_ptr<int>(const weak_ptr<int>&) throws bad_weak_ptr") {
+        weak_ptr<int> w_ptr;
+        {
+            shared_ptr<int> sh_ptr(5);
+            w_ptr = sh_ptr;
+        }
+
+        REQUIRE_THROWS_AS(shared_ptr<int>(w_ptr), bad_weak_ptr);
+        REQUIRE(w_ptr.use_count() == 0);
+    }
+
+    SECTION("Test shared_ptr<int>::operator=(const weak_ptr<int>&) gives empty shared_ptr") {
+        weak_ptr<int> w_ptr;
+        {
+            shared_ptr<int> sh_ptr(5);
+            w_ptr = sh_ptr;
+        }
+
+        shared_ptr<int> sh_ptr(10);
+        sh_ptr = w_ptr;
+        REQUIRE(sh_ptr.get() == nullptr);
+        REQUIRE(w_ptr.use_count() == 0);
+    }
+}
+
 TEST_CASE("Test shared_ptr copy constructor")
 {
     SECTION("Test shared_ptr<int> copy constructor")
@@ -127,6 +179,193 @@ TEST_CASE("Test shared_ptr operator=(const weak_ptr<T>&)") {
     }
 }
 
+TEST_CASE("Test shared_ptr move constructor") {
+    SECTION("Test shared_ptr<int> move constructor") {
+        int expected_value = 5;
+        shared_ptr<int> first_ptr(expected_value);
+
+        shared_ptr<int> second_ptr(std::move(first_ptr));
+        REQUIRE(*second_ptr == expected_value);
+        REQUIRE(second_ptr.use_count() == 1);
+        REQUIRE(first_ptr.get() == nullptr);
+        REQUIRE(first_ptr.use_count() == 0);
+    }
+
+    SECTION("Test shared_ptr<std::string> move constructor") {
+        std::string expected_value("hello world");
+        shared_ptr<std::string> first_ptr(expected_value);
+
+        shared_ptr<std::string> second_ptr(std::move(first_ptr));
+        REQUIRE(*second_ptr == expected_value);
+        REQUIRE(second_ptr.use_count() == 1);
+        REQUIRE(first_ptr.get() == nullptr);
+    }
+}
+
+TEST_CASE("Test shared_ptr move operator=") {
+    SECTION("Test shared_ptr<int> move operator=") {
+        int expected_value = 5;
+        shared_ptr<int> first_ptr(expected_value);
+        shared_ptr<int> second_ptr(10);
+        weak_ptr<int> w_ptr(second_ptr);
+
+        second_ptr = std::move(first_ptr);
+        REQUIRE(*second_ptr == expected_value);
+        REQUIRE(second_ptr.use_count() == 1);
+        REQUIRE(first_ptr.get() == nullptr);
+        REQUIRE(w_ptr.expired() == true);
+    }
+
+    SECTION("Test shared_ptr<std::string> move operator=") {
+        std::string expected_value("hello world");
+        shared_ptr<std::string> first_ptr(expected_value);
+        shared_ptr<std::string> second_ptr;
+
+        second_ptr = std::move(first_ptr);
+        REQUIRE(*second_ptr == expected_value);
+        REQUIRE(second_ptr.use_count() == 1);
+        REQUIRE(first_ptr.get() == nullptr);
+    }
+}
+
+TEST_CASE("Test shared_ptr swap and reset") {
+    SECTION("Test shared_ptr<int> swap") {
+        shared_ptr<int> first_ptr(5);
+        shared_ptr<int> second_ptr(first_ptr);
+        shared_ptr<int> third_ptr(10);
+
+        swap(first_ptr, third_ptr);
+        REQUIRE(*first_ptr == 10);
+        REQUIRE(*third_ptr == 5);
+        REQUIRE(first_ptr.use_count() == 1);
+        REQUIRE(third_ptr.use_count() == 2);
+    }
+
+    SECTION("Test shared_ptr<int> reset") {
+        shared_ptr<int> first_ptr(5);
+        shared_ptr<int> second_ptr(first_ptr);
+
+        first_ptr.reset();
+        REQUIRE(first_ptr.get() == nullptr);
+        REQUIRE(second_ptr.use_count() == 1);
+    }
+}
+
+TEST_CASE("Test shared_ptr relocation inside std::vector") {
+    typedef CountingPolicy<single_thread_policy> counting_policy;
+    typedef shared_ptr<std::string, counting_policy> counted_ptr;
+
+    counting_policy::adds = counting_policy::releases = 0;
+    std::vector<counted_ptr> ptrs;
+    for (int i = 0; i < 100; i++)
+        ptrs.push_back(counted_ptr(std::to_string(i)));
+
+    REQUIRE(counting_policy::adds == 0);
+    REQUIRE(counting_policy::releases == 0);
+    for (int i = 0; i < 100; i++) {
+        REQUIRE(*ptrs[i] == std::to_string(i));
+        REQUIRE(ptrs[i].use_count() == 1);
+    }
+
+    SECTION("Test hand-off by move") {
+        std::vector<counted_ptr> taken;
+        for (counted_ptr &ptr : ptrs)
+            taken.push_back(std::move(ptr));
+
+        REQUIRE(counting_policy::adds == 0);
+        REQUIRE(counting_policy::releases == 0);
+        REQUIRE(taken.back().use_count() == 1);
+    }
+
+    ptrs.clear();
+    REQUIRE(counting_policy::releases == 100);
+}
+
+namespace {
+    struct CopyCounter {
+        static size_t copies;
+        int first;
+        std::string second;
+
+        CopyCounter(int first, const std::string &second) : first(first), second(second) {}
+        CopyCounter(const CopyCounter &other) : first(other.first), second(other.second) {
+            copies++;
+        }
+    };
+
+    size_t CopyCounter::copies = 0;
+
+    struct NonCopyable {
+        std::unique_ptr<int> value;
+
+        explicit NonCopyable(int value) : value(new int(value)) {}
+        NonCopyable(const NonCopyable &) = delete;
+        NonCopyable &operator=(const NonCopyable &) = delete;
+    };
+}
+
+TEST_CASE("Test make_shared") {
+    SECTION("Test make_shared<int>") {
+        shared_ptr<int> ptr = make_shared<int>(5);
+        REQUIRE(*ptr == 5);
+        REQUIRE(ptr.use_count() == 1);
+    }
+
+    SECTION("Test make_shared<std::string> forwards constructor arguments") {
+        shared_ptr<std::string> ptr = make_shared<std::string>(3, 'a');
+        REQUIRE(*ptr == "aaa");
+    }
+
+    SECTION("Test unqualified calls with arguments from namespace std") {
+        shared_ptr<std::string> ptr = make_shared<std::string>(std::string("abc"));
+        REQUIRE(*ptr == "abc");
+
+        shared_ptr<std::string> allocated = allocate_shared<std::string>(std::allocator<std::string>(), "abc");
+        REQUIRE(*allocated == *ptr);
+    }
+
+    SECTION("Test make_shared constructs the object in place") {
+        CopyCounter::copies = 0;
+        shared_ptr<CopyCounter> ptr = make_shared<CopyCounter>(5, "hello");
+        REQUIRE(ptr->first == 5);
+        REQUIRE(ptr->second == "hello");
+        REQUIRE(CopyCounter::copies == 0);
+    }
+
+    SECTION("Test make_shared with non-copyable type") {
+        shared_ptr<NonCopyable> ptr = make_shared<NonCopyable>(7);
+        shared_ptr<NonCopyable> second_ptr(ptr);
+        REQUIRE(*second_ptr->value == 7);
+        REQUIRE(ptr.use_count() == 2);
+    }
+}
+
+TEST_CASE("Test make_shared alignment") {
+    struct alignas(64) OverAligned {
+        char value[3];
+    };
+
+    SECTION("Test control block adds no padding for ordinary types") {
+        REQUIRE(sizeof(AlignedStorage<int>) == sizeof(int));
+        REQUIRE(sizeof(AlignedStorage<double>) == sizeof(double));
+        REQUIRE(sizeof(AlignedStorage<std::string>) == sizeof(std::string));
+    }
+
+    SECTION("Test objects are aligned") {
+        for (int i = 0; i < 10; i++) {
+            shared_ptr<double> ptr = make_shared<double>(1.5);
+            REQUIRE(reinterpret_cast<uintptr_t>(ptr.get()) % alignof(double) == 0);
+        }
+    }
+
+    SECTION("Test over-aligned objects are aligned") {
+        for (int i = 0; i < 10; i++) {
+            shared_ptr<OverAligned> ptr = make_shared<OverAligned>();
+            REQUIRE(reinterpret_cast<uintptr_t>(ptr.get()) % alignof(OverAligned) == 0);
+        }
+    }
+}
+
 TEST_CASE("Test shared_ptr with shared ownership")
 {
     SECTION("Test shared_ptr<int> with shared ownership")
@@ -262,6 +501,43 @@ TEST_CASE("Test weak_ptr operator=(weak_ptr)") {
     }
 }
 
+TEST_CASE("Test weak_ptr move constructor and move operator=") {
+    SECTION("Test weak_ptr<int> move constructor") {
+        shared_ptr<int> sh_ptr(5);
+        weak_ptr<int> first_ptr(sh_ptr);
+        weak_ptr<int> second_ptr(std::move(first_ptr));
+
+        REQUIRE(second_ptr.expired() == false);
+        REQUIRE(second_ptr.use_count() == 1);
+        REQUIRE(first_ptr.expired() == true);
+    }
+
+    SECTION("Test weak_ptr<std::string> move operator=") {
+        shared_ptr<std::string> sh_ptr(std::string("hello"));
+        weak_ptr<std::string> first_ptr(sh_ptr);
+        weak_ptr<std::string> second_ptr;
+        second_ptr = std::move(first_ptr);
+
+        REQUIRE(second_ptr.expired() == false);
+        REQUIRE(second_ptr.use_count() == 1);
+        REQUIRE(first_ptr.expired() == true);
+    }
+
+    SECTION("Test weak_ptr<int> swap and reset") {
+        shared_ptr<int> sh_ptr(5);
+        weak_ptr<int> first_ptr(sh_ptr);
+        weak_ptr<int> second_ptr;
+
+        swap(first_ptr, second_ptr);
+        REQUIRE(first_ptr.expired() == true);
+        REQUIRE(second_ptr.expired() == false);
+
+        second_ptr.reset();
+        REQUIRE(second_ptr.expired() == true);
+        REQUIRE(sh_ptr.use_count() == 1);
+    }
+}
+
 TEST_CASE("Test weak_ptr lock method") {
     SECTION("Test weak_ptr<int> lock method") {
         int expected_value = 5;
@@ -284,6 +560,18 @@ TEST_CASE("Test weak_ptr lock method") {
     }
 }
 
+TEST_CASE("Test weak_ptr lock method with expired weak_ptr") {
+    weak_ptr<std::string> w_ptr;
+    {
+        shared_ptr<std::string> sh_ptr(std::string("hello"));
+        w_ptr = sh_ptr;
+    }
+
+    shared_ptr<std::string> sh_ptr = w_ptr.lock();
+    REQUIRE(sh_ptr.get() == nullptr);
+    REQUIRE(w_ptr.use_count() == 0);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 ///////////////////// shared_ptr & weak_ptr tests /////////////////////////
 ///////////////////////////////////////////////////////////////////////////
@@ -326,4 +614,2057 @@ TEST_CASE("Test shared ownership with shared_ptr & weak_ptr") {
         REQUIRE(w_ptr1->expired() == true);
         delete w_ptr1;
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Test shared_ptr aliasing constructor") {
+    struct Record {
+        std::string name;
+        int values[4];
+    };
+
+    SECTION("Test shared_ptr stores the element pointer next to the control block") {
+        REQUIRE(sizeof(shared_ptr<int>) == 2 * sizeof(void *));
+        REQUIRE(sizeof(weak_ptr<int>) == 2 * sizeof(void *));
+    }
+
+    SECTION("Test make_shared blocks of trivial types have no vtable") {
+        REQUIRE(sizeof(Storage<long, atomic_policy>) == sizeof(atomic_policy) + sizeof(long));
+        REQUIRE(sizeof(Storage<long, compact_atomic_policy>) == sizeof(compact_atomic_policy) + sizeof(long));
+        REQUIRE(sizeof(Storage<std::string>) == sizeof(ControlBlock<>) + sizeof(std::string));
+    }
+
+    SECTION("Test aliasing a block without a vtable") {
+        struct Point {
+            int x;
+            int y;
+        };
+
+        shared_ptr<Point> point = make_shared<Point>(Point{1, 2});
+        weak_ptr<Point> w_point(point);
+        shared_ptr<int> y(point, &point->y);
+        weak_ptr<int> w_y(y);
+
+        point.reset();
+        REQUIRE(*y == 2);
+        REQUIRE(w_y.lock().get() == y.get());
+        REQUIRE(y.use_count() == 1);
+
+        y.reset();
+        REQUIRE(w_point.expired() == true);
+        REQUIRE(w_y.expired() == true);
+    }
+
+    SECTION("Test aliasing a member") {
+        shared_ptr<Record> record = make_shared<Record>(Record{"abc", {1, 2, 3, 4}});
+        shared_ptr<std::string> name(record, &record->name);
+        REQUIRE(*name == "abc");
+        REQUIRE(name.get() == &record->name);
+        REQUIRE(record.use_count() == 2);
+        REQUIRE(name.use_count() == 2);
+        REQUIRE(!name.owner_before(record));
+        REQUIRE(!record.owner_before(name));
+    }
+
+    SECTION("Test aliasing an element keeps the whole object alive") {
+        shared_ptr<Record> record = make_shared<Record>(Record{"abc", {1, 2, 3, 4}});
+        weak_ptr<Record> w_record(record);
+        shared_ptr<int> element(record, &record->values[2]);
+
+        record.reset();
+        REQUIRE(w_record.expired() == false);
+        REQUIRE(*element == 3);
+        REQUIRE(element.use_count() == 1);
+
+        element.reset();
+        REQUIRE(w_record.expired() == true);
+    }
+
+    SECTION("Test aliasing move constructor") {
+        shared_ptr<Record> record = make_shared<Record>(Record{"abc", {1, 2, 3, 4}});
+        Record *object = record.get();
+        shared_ptr<int> element(std::move(record), &object->values[1]);
+        REQUIRE(record.get() == nullptr);
+        REQUIRE(record.use_count() == 0);
+        REQUIRE(*element == 2);
+        REQUIRE(element.use_count() == 1);
+    }
+
+    SECTION("Test weak_ptr locks the aliased pointer") {
+        shared_ptr<Record> record = make_shared<Record>(Record{"abc", {1, 2, 3, 4}});
+        weak_ptr<std::string> w_name(shared_ptr<std::string>(record, &record->name));
+        REQUIRE(w_name.lock().get() == &record->name);
+
+        record.reset();
+        REQUIRE(w_name.expired() == true);
+        REQUIRE(w_name.lock().get() == nullptr);
+    }
+
+    SECTION("Test assignment between aliases of one object") {
+        shared_ptr<Record> record = make_shared<Record>(Record{"abc", {1, 2, 3, 4}});
+        shared_ptr<int> first(record, &record->values[0]);
+        shared_ptr<int> last(record, &record->values[3]);
+
+        first = last;
+        REQUIRE(*first == 4);
+        REQUIRE(record.use_count() == 3);
+    }
+}
+
+namespace {
+    struct CountingDeleter {
+        int *deleted;
+
+        void operator()(int *object) const {
+            (*deleted)++;
+            delete object;
+        }
+    };
+
+    struct StatelessDeleter {
+        void operator()(int *object) const {
+            delete object;
+        }
+    };
+
+    template <class T>
+    struct CountingAllocator {
+        typedef T value_type;
+
+        int *allocations;
+        bool fail;
+
+        CountingAllocator(int *allocations, bool fail = false) : allocations(allocations), fail(fail) {}
+
+        template <class U>
+        CountingAllocator(const CountingAllocator<U> &other) : allocations(other.allocations), fail(other.fail) {}
+
+        T *allocate(size_t count) {
+            if (fail)
+                throw std::bad_alloc();
+
+            (*allocations)++;
+            return static_cast<T *>(::operator new(count * sizeof(T)));
+        }
+
+        void deallocate(T *object, size_t) {
+            (*allocations)--;
+            ::operator delete(object);
+        }
+    };
+
+    template <class T, class U>
+    bool operator==(const CountingAllocator<T> &lhs, const CountingAllocator<U> &rhs) {
+        return lhs.allocations == rhs.allocations;
+    }
+
+    template <class T, class U>
+    bool operator!=(const CountingAllocator<T> &lhs, const CountingAllocator<U> &rhs) {
+        return !(lhs == rhs);
+    }
+}
+
+TEST_CASE("Test shared_ptr with custom deleter") {
+    SECTION("Test stateless deleter and allocator take no space") {
+        REQUIRE(sizeof(PointerStorage<int, StatelessDeleter, std::allocator<int>>) ==
+            sizeof(ControlBlock<>) + sizeof(int *));
+    }
+
+    SECTION("Test deleter runs once for the last owner") {
+        int deleted = 0;
+        int *object = new int(5);
+        shared_ptr<int> ptr(object, CountingDeleter{&deleted});
+        REQUIRE(ptr.get() == object);
+        REQUIRE(ptr.use_count() == 1);
+
+        shared_ptr<int> second_ptr(ptr);
+        weak_ptr<int> w_ptr(ptr);
+        ptr.reset();
+        REQUIRE(deleted == 0);
+
+        second_ptr.reset();
+        REQUIRE(deleted == 1);
+        REQUIRE(w_ptr.expired() == true);
+    }
+
+    SECTION("Test function pointer deleter adopts a malloc buffer") {
+        char *buffer = static_cast<char *>(std::malloc(16));
+        shared_ptr<char> ptr(buffer, std::free);
+        buffer[0] = 'a';
+        REQUIRE(*ptr == 'a');
+    }
+
+    SECTION("Test stateful deleter is stored in the control block") {
+        int allocations = 0;
+        int deleted = 0;
+        {
+            shared_ptr<int> ptr(new int(5), CountingDeleter{&deleted}, CountingAllocator<int>(&allocations));
+            REQUIRE(allocations == 1);
+
+            weak_ptr<int> w_ptr(ptr);
+            ptr.reset();
+            REQUIRE(deleted == 1);
+            REQUIRE(allocations == 1);
+        }
+        REQUIRE(allocations == 0);
+    }
+
+    SECTION("Test object is deleted if the control block can not be allocated") {
+        int allocations = 0;
+        int deleted = 0;
+        REQUIRE_THROWS_AS(shared_ptr<int>(new int(5), CountingDeleter{&deleted},
+            CountingAllocator<int>(&allocations, true)), std::bad_alloc);
+        REQUIRE(deleted == 1);
+        REQUIRE(allocations == 0);
+    }
+}
+
+namespace {
+    struct Base {
+        int value;
+
+        explicit Base(int value) : value(value) {}
+        virtual ~Base() {}
+    };
+
+    struct Derived : Base {
+        std::string name;
+
+        Derived(int value, const std::string &name) : Base(value), name(name) {}
+    };
+
+    struct Other : Base {
+        explicit Other(int value) : Base(value) {}
+    };
+}
+
+TEST_CASE("Test shared_ptr converting constructors") {
+    SECTION("Test shared_ptr<Base> from shared_ptr<Derived>") {
+        shared_ptr<Derived> derived = make_shared<Derived>(5, "derived");
+        shared_ptr<Base> base(derived);
+        REQUIRE(base->value == 5);
+        REQUIRE(base.get() == derived.get());
+        REQUIRE(derived.use_count() == 2);
+
+        shared_ptr<Base> moved(std::move(derived));
+        REQUIRE(derived.get() == nullptr);
+        REQUIRE(moved.use_count() == 2);
+    }
+
+    SECTION("Test shared_ptr<Base> operator= from shared_ptr<Derived>") {
+        shared_ptr<Derived> derived = make_shared<Derived>(5, "derived");
+        shared_ptr<Base> base = make_shared<Base>(1);
+        weak_ptr<Base> w_old(base);
+
+        base = derived;
+        REQUIRE(w_old.expired() == true);
+        REQUIRE(base->value == 5);
+        REQUIRE(derived.use_count() == 2);
+
+        base = make_shared<Derived>(7, "other");
+        REQUIRE(base->value == 7);
+        REQUIRE(derived.use_count() == 1);
+    }
+
+    SECTION("Test weak_ptr<Base> from shared_ptr<Derived> and weak_ptr<Derived>") {
+        shared_ptr<Derived> derived = make_shared<Derived>(5, "derived");
+        weak_ptr<Derived> w_derived(derived);
+        weak_ptr<Base> w_base(derived);
+        weak_ptr<Base> w_copy(w_derived);
+        REQUIRE(w_base.lock().get() == derived.get());
+        REQUIRE(w_copy.lock().get() == derived.get());
+
+        shared_ptr<Base> base(w_derived);
+        REQUIRE(base->value == 5);
+
+        base.reset();
+        derived.reset();
+        REQUIRE(w_copy.expired() == true);
+        REQUIRE_THROWS_AS(shared_ptr<Base>(w_derived), bad_weak_ptr);
+
+        weak_ptr<Base> w_expired(w_derived);
+        REQUIRE(w_expired.expired() == true);
+    }
+}
+
+TEST_CASE("Test pointer casts") {
+    SECTION("Test static_pointer_cast") {
+        shared_ptr<Base> base = make_shared<Derived>(5, "derived");
+        shared_ptr<Derived> derived = static_pointer_cast<Derived>(base);
+        REQUIRE(derived->name == "derived");
+        REQUIRE(base.use_count() == 2);
+    }
+
+    SECTION("Test dynamic_pointer_cast") {
+        shared_ptr<Base> base = make_shared<Derived>(5, "derived");
+        shared_ptr<Derived> derived = dynamic_pointer_cast<Derived>(base);
+        REQUIRE(derived->name == "derived");
+        REQUIRE(base.use_count() == 2);
+
+        shared_ptr<Other> other = dynamic_pointer_cast<Other>(base);
+        REQUIRE(other.get() == nullptr);
+        REQUIRE(other.use_count() == 0);
+        REQUIRE(base.use_count() == 2);
+    }
+
+    SECTION("Test const_pointer_cast") {
+        shared_ptr<const int> constant = make_shared<int>(5);
+        shared_ptr<int> mutable_ptr = const_pointer_cast<int>(constant);
+        *mutable_ptr = 6;
+        REQUIRE(*constant == 6);
+        REQUIRE(constant.use_count() == 2);
+    }
+
+    SECTION("Test reinterpret_pointer_cast") {
+        shared_ptr<int> ptr = make_shared<int>(5);
+        shared_ptr<char> bytes = reinterpret_pointer_cast<char>(ptr);
+        REQUIRE(static_cast<void *>(bytes.get()) == static_cast<void *>(ptr.get()));
+        REQUIRE(ptr.use_count() == 2);
+    }
+}
+
+namespace {
+    struct Session : enable_shared_from_this<Session> {
+        int *destroyed;
+        std::vector<shared_ptr<Session>> *callbacks;
+
+        Session(int *destroyed, std::vector<shared_ptr<Session>> *callbacks)
+            : destroyed(destroyed), callbacks(callbacks) {}
+
+        ~Session() {
+            (*destroyed)++;
+        }
+
+        void start() {
+            callbacks->push_back(shared_from_this());
+        }
+    };
+
+    struct DerivedSession : Session {
+        using Session::Session;
+    };
+}
+
+TEST_CASE("Test enable_shared_from_this") {
+    int destroyed = 0;
+    std::vector<shared_ptr<Session>> callbacks;
+
+    SECTION("Test shared_from_this shares ownership") {
+        shared_ptr<Session> session = make_shared<Session>(&destroyed, &callbacks);
+        REQUIRE(session.use_count() == 1);
+
+        session->start();
+        REQUIRE(session.use_count() == 2);
+        REQUIRE(callbacks[0].get() == session.get());
+
+        session.reset();
+        REQUIRE(destroyed == 0);
+        callbacks.clear();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test self-reference does not keep the object alive") {
+        shared_ptr<Session> session = make_shared<Session>(&destroyed, &callbacks);
+        weak_ptr<Session> w_session = session->weak_from_this();
+        REQUIRE(w_session.lock().get() == session.get());
+
+        session.reset();
+        REQUIRE(destroyed == 1);
+        REQUIRE(w_session.expired() == true);
+    }
+
+    SECTION("Test shared_from_this on an object that is not owned") {
+        Session session(&destroyed, &callbacks);
+        REQUIRE_THROWS_AS(session.shared_from_this(), bad_weak_ptr);
+        REQUIRE(session.weak_from_this().expired() == true);
+    }
+
+    SECTION("Test shared_from_this with other factories") {
+        shared_ptr<Session> adopted(new Session(&destroyed, &callbacks), [](Session *session) {
+            delete session;
+        });
+        REQUIRE(adopted->shared_from_this().get() == adopted.get());
+
+        shared_ptr<Session> derived = make_shared<DerivedSession>(&destroyed, &callbacks);
+        REQUIRE(derived->shared_from_this().get() == derived.get());
+
+        const Session &constant = *derived;
+        shared_ptr<const Session> const_ptr = constant.shared_from_this();
+        REQUIRE(derived.use_count() == 2);
+    }
+
+    SECTION("Test copies do not share the weak reference") {
+        shared_ptr<Session> session = make_shared<Session>(&destroyed, &callbacks);
+        shared_ptr<Session> copy(*session);
+        REQUIRE(copy->shared_from_this().get() == copy.get());
+        REQUIRE(session.use_count() == 1);
+    }
+}
+
+namespace {
+    struct ThrowingElement {
+        static int constructed;
+        static int destroyed;
+
+        ThrowingElement() {
+            if (constructed == 3)
+                throw std::runtime_error("element can not be constructed");
+            constructed++;
+        }
+
+        ~ThrowingElement() {
+            destroyed++;
+        }
+    };
+
+    int ThrowingElement::constructed = 0;
+    int ThrowingElement::destroyed = 0;
+}
+
+TEST_CASE("Test shared_ptr<T[]>") {
+    SECTION("Test make_shared<T[]> value-initializes the elements") {
+        shared_ptr<int[]> array = make_shared<int[]>(100);
+        for (int i = 0; i < 100; i++)
+            REQUIRE(array[i] == 0);
+
+        array[99] = 5;
+        REQUIRE(array.get()[99] == 5);
+        REQUIRE(array.use_count() == 1);
+    }
+
+    SECTION("Test elements are destroyed with the last owner") {
+        ThrowingElement::constructed = 0;
+        ThrowingElement::destroyed = 0;
+        shared_ptr<ThrowingElement[]> array = make_shared<ThrowingElement[]>(3);
+        shared_ptr<ThrowingElement> last(array, &array[2]);
+
+        array.reset();
+        REQUIRE(ThrowingElement::destroyed == 0);
+        last.reset();
+        REQUIRE(ThrowingElement::destroyed == 3);
+    }
+
+    SECTION("Test shared_ptr<std::string[]>") {
+        shared_ptr<std::string[]> strings = make_shared<std::string[]>(3);
+        strings[2] = "last";
+        REQUIRE(strings[0].empty());
+        REQUIRE(strings[2] == "last");
+    }
+
+    SECTION("Test make_shared_for_overwrite<T[]>") {
+        shared_ptr<double[]> array = make_shared_for_overwrite<double[]>(16);
+        for (int i = 0; i < 16; i++)
+            array[i] = i;
+        REQUIRE(array[15] == 15.0);
+    }
+
+    SECTION("Test requested alignment") {
+        for (int i = 0; i < 10; i++) {
+            shared_ptr<float[]> array = make_shared<float[]>(i + 1, aligned_to<64>());
+            REQUIRE(reinterpret_cast<uintptr_t>(array.get()) % 64 == 0);
+
+            shared_ptr<float[]> overwrite = make_shared_for_overwrite<float[]>(i + 1, aligned_to<128>());
+            REQUIRE(reinterpret_cast<uintptr_t>(overwrite.get()) % 128 == 0);
+
+            shared_ptr<double[]> natural = make_shared<double[]>(i + 1);
+            REQUIRE(reinterpret_cast<uintptr_t>(natural.get()) % alignof(double) == 0);
+        }
+    }
+
+    SECTION("Test array of zero elements") {
+        shared_ptr<int[]> array = make_shared<int[]>(0);
+        REQUIRE(array.use_count() == 1);
+    }
+
+    SECTION("Test constructed elements are destroyed if one throws") {
+        ThrowingElement::constructed = 0;
+        ThrowingElement::destroyed = 0;
+        REQUIRE_THROWS_AS(make_shared<ThrowingElement[]>(10), std::runtime_error);
+        REQUIRE(ThrowingElement::destroyed == 3);
+    }
+
+    SECTION("Test too many elements") {
+        REQUIRE_THROWS_AS(make_shared<int[]>(SIZE_MAX / 2), std::bad_array_new_length);
+    }
+
+    SECTION("Test weak_ptr<T[]> and custom deleter") {
+        shared_ptr<int[]> array(new int[4](), [](int *object) {
+            delete[] object;
+        });
+        weak_ptr<int[]> w_array(array);
+        REQUIRE(w_array.lock()[3] == 0);
+
+        array.reset();
+        REQUIRE(w_array.expired() == true);
+    }
+}
+
+namespace {
+    struct MessageHeader {
+        int type;
+        size_t length;
+
+        MessageHeader(int type, size_t length) : type(type), length(length) {}
+    };
+
+    struct alignas(64) CacheLineHeader {
+        int type;
+    };
+}
+
+TEST_CASE("Test make_shared_with_trailing") {
+    SECTION("Test header and tail share one block") {
+        shared_ptr<MessageHeader> message = make_shared_with_trailing<MessageHeader, char>(64, 7, 64);
+        span<char> payload = trailing<char>(message);
+        REQUIRE(message->type == 7);
+        REQUIRE(payload.size() == 64);
+        REQUIRE(payload.data() == reinterpret_cast<char *>(message.get() + 1));
+
+        for (char byte : payload)
+            REQUIRE(byte == 0);
+    }
+
+    SECTION("Test tail is aligned") {
+        shared_ptr<char> header = make_shared_with_trailing<char, double>(3, 'a');
+        span<double> tail = trailing<double>(header);
+        REQUIRE(reinterpret_cast<uintptr_t>(tail.data()) % alignof(double) == 0);
+        REQUIRE(reinterpret_cast<char *>(tail.data()) - header.get() < int(alignof(double) + 1));
+
+        tail[2] = 1.5;
+        REQUIRE(trailing<double>(header)[2] == 1.5);
+    }
+
+    SECTION("Test over-aligned header") {
+        std::vector<shared_ptr<CacheLineHeader>> headers;
+        for (size_t i = 0; i < 64; i++) {
+            headers.push_back(make_shared_with_trailing<CacheLineHeader, char>(i, CacheLineHeader{int(i)}));
+            REQUIRE(reinterpret_cast<uintptr_t>(headers.back().get()) % 64 == 0);
+            REQUIRE(trailing<char>(headers.back()).size() == i);
+        }
+    }
+
+    SECTION("Test tail is reachable from an alias") {
+        shared_ptr<MessageHeader> message = make_shared_with_trailing<MessageHeader, int>(4, 1, 4);
+        trailing<int>(message)[3] = 9;
+
+        shared_ptr<size_t> length(message, &message->length);
+        message.reset();
+        REQUIRE(*length == 4);
+        REQUIRE(trailing<int>(length)[3] == 9);
+        REQUIRE(trailing<int>(shared_ptr<int>()).empty());
+    }
+
+    SECTION("Test tail elements are destroyed with the header") {
+        ThrowingElement::constructed = 0;
+        ThrowingElement::destroyed = 0;
+        shared_ptr<MessageHeader> message = make_shared_with_trailing<MessageHeader, ThrowingElement>(2, 1, 2);
+        message.reset();
+        REQUIRE(ThrowingElement::destroyed == 2);
+
+        ThrowingElement::constructed = 0;
+        ThrowingElement::destroyed = 0;
+        REQUIRE_THROWS_AS((make_shared_with_trailing<MessageHeader, ThrowingElement>(5, 1, 5)), std::runtime_error);
+        REQUIRE(ThrowingElement::destroyed == 3);
+    }
+}
+
+TEST_CASE("Test allocate_shared") {
+    SECTION("Test stateless allocator takes no space") {
+        REQUIRE(sizeof(AllocatedStorage<std::string, std::allocator<int>>) == sizeof(Storage<std::string>));
+    }
+
+    SECTION("Test control block is one allocation from the allocator") {
+        int allocations = 0;
+        {
+            shared_ptr<std::string> ptr = allocate_shared<std::string>(CountingAllocator<int>(&allocations), "hello");
+            REQUIRE(*ptr == "hello");
+            REQUIRE(allocations == 1);
+
+            weak_ptr<std::string> w_ptr(ptr);
+            ptr.reset();
+            REQUIRE(w_ptr.expired() == true);
+            REQUIRE(allocations == 1);
+        }
+        REQUIRE(allocations == 0);
+    }
+
+    SECTION("Test allocator failure") {
+        int allocations = 0;
+        REQUIRE_THROWS_AS(allocate_shared<int>(CountingAllocator<int>(&allocations, true), 5), std::bad_alloc);
+        REQUIRE(allocations == 0);
+    }
+
+    SECTION("Test block is freed if the object throws") {
+        int allocations = 0;
+        ThrowingElement::constructed = 3;
+        REQUIRE_THROWS_AS(allocate_shared<ThrowingElement>(CountingAllocator<int>(&allocations)), std::runtime_error);
+        REQUIRE(allocations == 0);
+    }
+}
+
+#if __cplusplus >= 201703L
+namespace {
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        int allocations = 0;
+        size_t allocated = 0;
+        size_t deallocated = 0;
+
+    private:
+        void *do_allocate(size_t bytes, size_t alignment) override {
+            allocations++;
+            allocated += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *object, size_t bytes, size_t alignment) override {
+            allocations--;
+            deallocated += bytes;
+            std::pmr::new_delete_resource()->deallocate(object, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+    };
+}
+
+TEST_CASE("Test allocate_shared with std::pmr") {
+    CountingResource resource;
+
+    SECTION("Test block is returned with its exact size") {
+        shared_ptr<int> ptr = allocate_shared<int>(std::pmr::polymorphic_allocator<int>(&resource), 5);
+        REQUIRE(*ptr == 5);
+        REQUIRE(resource.allocations == 1);
+        REQUIRE(resource.allocated >= sizeof(Storage<int>));
+
+        ptr.reset();
+        REQUIRE(resource.allocations == 0);
+        REQUIRE(resource.deallocated == resource.allocated);
+    }
+
+    SECTION("Test the allocator is passed on to the object") {
+        shared_ptr<std::pmr::string> ptr =
+            allocate_shared<std::pmr::string>(std::pmr::polymorphic_allocator<char>(&resource), 100, 'a');
+        REQUIRE(ptr->size() == 100);
+        REQUIRE(ptr->get_allocator().resource() == &resource);
+        REQUIRE(resource.allocations == 2);
+
+        ptr.reset();
+        REQUIRE(resource.allocations == 0);
+        REQUIRE(resource.deallocated == resource.allocated);
+    }
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////// reference counting tests /////////////////////////
+///////////////////////////////////////////////////////////////////////////
+
+namespace {
+    struct DestructionCounter {
+        std::atomic<int> *destroyed;
+
+        explicit DestructionCounter(std::atomic<int> *destroyed) : destroyed(destroyed) {}
+        ~DestructionCounter() {
+            destroyed->fetch_add(1);
+        }
+    };
+
+    const int thread_count = 4;
+    const int iterations = 10000;
+}
+
+TEST_CASE("Test shared_ptr with single_thread_policy") {
+    shared_ptr<std::string, single_thread_policy> first_ptr =
+        make_shared<std::string, single_thread_policy>("hello");
+    weak_ptr<std::string, single_thread_policy> w_ptr(first_ptr);
+    {
+        shared_ptr<std::string, single_thread_policy> second_ptr = w_ptr.lock();
+        REQUIRE(*second_ptr == "hello");
+        REQUIRE(first_ptr.use_count() == 2);
+    }
+    REQUIRE(first_ptr.use_count() == 1);
+
+    first_ptr.reset();
+    REQUIRE(w_ptr.expired() == true);
+}
+
+TEST_CASE("Test shared_ptr with atomic_policy across threads") {
+    SECTION("Test concurrent copies and releases of shared_ptr") {
+        std::atomic<int> destroyed(0);
+        shared_ptr<DestructionCounter, atomic_policy> ptr =
+            make_shared<DestructionCounter, atomic_policy>(&destroyed);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; i++) {
+            threads.emplace_back([ptr]() {
+                for (int j = 0; j < iterations; j++) {
+                    shared_ptr<DestructionCounter, atomic_policy> copy(ptr);
+                    shared_ptr<DestructionCounter, atomic_policy> moved(std::move(copy));
+                }
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        REQUIRE(ptr.use_count() == 1);
+        REQUIRE(destroyed == 0);
+
+        ptr.reset();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test last owner is released on another thread") {
+        std::atomic<int> destroyed(0);
+        for (int i = 0; i < 100; i++) {
+            shared_ptr<DestructionCounter, atomic_policy> ptr =
+                make_shared<DestructionCounter, atomic_policy>(&destroyed);
+            weak_ptr<DestructionCounter, atomic_policy> w_ptr(ptr);
+
+            std::vector<std::thread> threads;
+            for (int j = 0; j < thread_count; j++) {
+                shared_ptr<DestructionCounter, atomic_policy> copy(ptr);
+                weak_ptr<DestructionCounter, atomic_policy> w_copy(w_ptr);
+                threads.emplace_back([copy, w_copy]() mutable {
+                    copy.reset();
+                    w_copy.reset();
+                });
+            }
+            ptr.reset();
+            w_ptr.reset();
+
+            for (std::thread &thread : threads)
+                thread.join();
+        }
+
+        REQUIRE(destroyed == 100);
+    }
+}
+
+TEST_CASE("Test weak_ptr lock racing with the last shared_ptr release") {
+    struct Tracked {
+        std::atomic<bool> alive{true};
+        ~Tracked() {
+            alive = false;
+        }
+    };
+
+    std::atomic<int> resurrected(0);
+    for (int i = 0; i < 100; i++) {
+        shared_ptr<Tracked> ptr = make_shared<Tracked>();
+        weak_ptr<Tracked> w_ptr(ptr);
+        std::atomic<bool> start(false);
+
+        std::vector<std::thread> threads;
+        for (int j = 0; j < thread_count; j++) {
+            threads.emplace_back([w_ptr, &start, &resurrected]() {
+                while (!start) {}
+                for (int k = 0; k < 100; k++) {
+                    shared_ptr<Tracked> locked = w_ptr.lock();
+                    if (locked && !locked->alive)
+                        resurrected++;
+                }
+            });
+        }
+
+        start = true;
+        ptr.reset();
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        REQUIRE(w_ptr.expired() == true);
+    }
+
+    REQUIRE(resurrected == 0);
+}
+
+TEST_CASE("Test shared_ptr with biased_policy") {
+    typedef shared_ptr<DestructionCounter, biased_policy> biased_ptr;
+    typedef weak_ptr<DestructionCounter, biased_policy> biased_weak_ptr;
+
+    SECTION("Test copies on the owner thread") {
+        std::atomic<int> destroyed(0);
+        biased_ptr ptr = make_shared<DestructionCounter, biased_policy>(&destroyed);
+        {
+            biased_ptr copy(ptr);
+            biased_weak_ptr w_ptr(copy);
+            REQUIRE(ptr.use_count() == 2);
+            REQUIRE(w_ptr.lock().use_count() == 3);
+        }
+        REQUIRE(ptr.use_count() == 1);
+
+        ptr.reset();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test owner releases last after other threads") {
+        std::atomic<int> destroyed(0);
+        biased_ptr ptr = make_shared<DestructionCounter, biased_policy>(&destroyed);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; i++) {
+            threads.emplace_back([ptr]() {
+                for (int j = 0; j < 1000; j++) {
+                    biased_ptr copy(ptr);
+                }
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        // the captured copies were counted here and released on the threads
+        biased_policy::merge_pending();
+        REQUIRE(ptr.use_count() == 1);
+        ptr.reset();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test references counted by the owner are released by another thread") {
+        std::atomic<int> destroyed(0);
+        biased_ptr ptr = make_shared<DestructionCounter, biased_policy>(&destroyed);
+        biased_ptr copy(ptr);
+
+        ptr.reset();
+        std::thread([&copy]() {
+            copy.reset();
+        }).join();
+
+        // the last reference went to the owner's queue
+        REQUIRE(destroyed == 0);
+        biased_policy::merge_pending();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test owner thread exits before the other threads release") {
+        std::atomic<int> destroyed(0);
+        biased_ptr escaped;
+        biased_weak_ptr w_ptr;
+
+        std::thread([&escaped, &w_ptr, &destroyed]() {
+            biased_ptr ptr = make_shared<DestructionCounter, biased_policy>(&destroyed);
+            escaped = ptr;
+            w_ptr = ptr;
+        }).join();
+
+        REQUIRE(destroyed == 0);
+        REQUIRE(w_ptr.lock().use_count() == 2);
+
+        escaped.reset();
+        REQUIRE(destroyed == 1);
+        REQUIRE(w_ptr.expired() == true);
+    }
+
+    SECTION("Test mixed concurrent copies and releases") {
+        std::atomic<int> destroyed(0);
+        for (int i = 0; i < 100; i++) {
+            biased_ptr ptr = make_shared<DestructionCounter, biased_policy>(&destroyed);
+
+            std::vector<biased_ptr> copies(thread_count, ptr);
+            std::vector<std::thread> threads;
+            for (int j = 0; j < thread_count; j++) {
+                threads.emplace_back([&copies, j]() {
+                    biased_ptr local(std::move(copies[j]));
+                    for (int k = 0; k < 100; k++) {
+                        biased_ptr copy(local);
+                    }
+                });
+            }
+            ptr.reset();
+
+            for (std::thread &thread : threads)
+                thread.join();
+            biased_policy::merge_pending();
+        }
+
+        REQUIRE(destroyed == 100);
+    }
+}
+
+namespace {
+    // Starts with its shared count one below the limit of the compact
+    // policies. The extra counts are dropped with the last real owner, so the
+    // block is still freed.
+    class SaturatedPolicy : public compact_single_thread_policy {
+    private:
+        static const size_t extra = (size_t(1) << 31) - 2;
+
+        size_t m_weak_count = 1;
+
+    public:
+        SaturatedPolicy() {
+            add_shared(extra);
+        }
+
+        bool release_shared() {
+            if (use_count() != extra + 1)
+                return compact_single_thread_policy::release_shared();
+
+            // Starts over from one owner and the weak references held now.
+            static_cast<compact_single_thread_policy &>(*this) = compact_single_thread_policy();
+            for (size_t i = 1; i < m_weak_count; i++)
+                compact_single_thread_policy::add_weak();
+            return compact_single_thread_policy::release_shared();
+        }
+
+        void add_weak() {
+            compact_single_thread_policy::add_weak();
+            m_weak_count++;
+        }
+
+        bool release_weak() {
+            m_weak_count--;
+            return compact_single_thread_policy::release_weak();
+        }
+    };
+}
+
+TEST_CASE("Test shared_ptr with compact policies") {
+    SECTION("Test compact policies shrink the control block") {
+        REQUIRE(sizeof(compact_single_thread_policy) == 8);
+        REQUIRE(sizeof(compact_atomic_policy) == 8);
+        REQUIRE(sizeof(Storage<int, compact_atomic_policy>) < sizeof(Storage<int, atomic_policy>));
+        REQUIRE(sizeof(Storage<std::string, compact_single_thread_policy>) <
+            sizeof(Storage<std::string, single_thread_policy>));
+    }
+
+    SECTION("Test compact_single_thread_policy") {
+        shared_ptr<int, compact_single_thread_policy> ptr = make_shared<int, compact_single_thread_policy>(5);
+        weak_ptr<int, compact_single_thread_policy> w_ptr(ptr);
+        REQUIRE(w_ptr.lock().use_count() == 2);
+
+        ptr.reset();
+        REQUIRE(w_ptr.expired() == true);
+    }
+
+    SECTION("Test compact_atomic_policy without weak_ptr") {
+        std::atomic<int> destroyed(0);
+        shared_ptr<DestructionCounter, compact_atomic_policy> ptr =
+            make_shared<DestructionCounter, compact_atomic_policy>(&destroyed);
+        shared_ptr<DestructionCounter, compact_atomic_policy> copy(ptr);
+        REQUIRE(ptr.use_count() == 2);
+
+        copy.reset();
+        REQUIRE(destroyed == 0);
+        ptr.reset();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test compact_atomic_policy with weak_ptr") {
+        std::atomic<int> destroyed(0);
+        shared_ptr<DestructionCounter, compact_atomic_policy> ptr =
+            make_shared<DestructionCounter, compact_atomic_policy>(&destroyed);
+        weak_ptr<DestructionCounter, compact_atomic_policy> w_ptr(ptr);
+        REQUIRE(w_ptr.lock().use_count() == 2);
+
+        ptr.reset();
+        REQUIRE(destroyed == 1);
+        REQUIRE(w_ptr.expired() == true);
+        REQUIRE(w_ptr.lock().get() == nullptr);
+    }
+
+    SECTION("Test compact policy counts overflow") {
+        Storage<int, compact_atomic_policy> storage(5);
+        storage.add_shared((size_t(1) << 31) - 2);
+        REQUIRE_THROWS_AS(storage.add_shared(), std::overflow_error);
+        REQUIRE(storage.use_count() == (size_t(1) << 31) - 1);
+
+        compact_single_thread_policy counts;
+        counts.add_shared((size_t(1) << 31) - 2);
+        REQUIRE_THROWS_AS(counts.add_shared(), std::overflow_error);
+    }
+
+    SECTION("Test converting copies and casts throw on overflow") {
+        struct Point {
+            int x;
+            int y;
+        };
+
+        shared_ptr<Point, SaturatedPolicy> point = make_shared<Point, SaturatedPolicy>(Point{1, 2});
+        REQUIRE_THROWS_AS((shared_ptr<const Point, SaturatedPolicy>(point)), std::overflow_error);
+        REQUIRE_THROWS_AS((shared_ptr<int, SaturatedPolicy>(point, &point->y)), std::overflow_error);
+        REQUIRE_THROWS_AS(const_pointer_cast<const Point>(point), std::overflow_error);
+
+        shared_ptr<const Point, SaturatedPolicy> converted;
+        REQUIRE_THROWS_AS(converted = point, std::overflow_error);
+        REQUIRE(converted.get() == nullptr);
+        REQUIRE(point.use_count() == (size_t(1) << 31) - 1);
+    }
+
+    SECTION("Test copy assignment and lock keep both sides on overflow") {
+        std::atomic<int> destroyed(0);
+        typedef shared_ptr<DestructionCounter, SaturatedPolicy> saturated_ptr;
+
+        saturated_ptr source = make_shared<DestructionCounter, SaturatedPolicy>(&destroyed);
+        weak_ptr<DestructionCounter, SaturatedPolicy> w_source(source);
+        {
+            saturated_ptr target = make_shared<DestructionCounter, SaturatedPolicy>(&destroyed);
+            DestructionCounter *object = target.get();
+
+            REQUIRE_THROWS_AS(target = source, std::overflow_error);
+            REQUIRE(target.get() == object);
+            REQUIRE_THROWS_AS(target = w_source, std::overflow_error);
+            REQUIRE(target.get() == object);
+            REQUIRE_THROWS_AS(w_source.lock(), std::overflow_error);
+        }
+
+        REQUIRE(destroyed == 1);
+        REQUIRE(source.use_count() == (size_t(1) << 31) - 1);
+        source.reset();
+        REQUIRE(destroyed == 2);
+        REQUIRE(w_source.expired() == true);
+    }
+
+    SECTION("Test compact_atomic_policy across threads") {
+        std::atomic<int> destroyed(0);
+        for (int i = 0; i < 100; i++) {
+            shared_ptr<DestructionCounter, compact_atomic_policy> ptr =
+                make_shared<DestructionCounter, compact_atomic_policy>(&destroyed);
+            weak_ptr<DestructionCounter, compact_atomic_policy> w_ptr(ptr);
+
+            std::vector<std::thread> threads;
+            for (int j = 0; j < thread_count; j++) {
+                threads.emplace_back([w_ptr]() {
+                    for (int k = 0; k < 100; k++) {
+                        shared_ptr<DestructionCounter, compact_atomic_policy> locked = w_ptr.lock();
+                    }
+                });
+            }
+            ptr.reset();
+
+            for (std::thread &thread : threads)
+                thread.join();
+        }
+
+        REQUIRE(destroyed == 100);
+    }
+}
+
+TEST_CASE("Test shared_ptr with deferred_policy") {
+    typedef deferred_policy<> Deferred;
+    deferred_reclaimer::drain();
+
+    SECTION("Test last release only queues the object") {
+        std::atomic<int> destroyed(0);
+        shared_ptr<DestructionCounter, Deferred> ptr = make_shared<DestructionCounter, Deferred>(&destroyed);
+        weak_ptr<DestructionCounter, Deferred> w_ptr(ptr);
+
+        ptr.reset();
+        REQUIRE(destroyed == 0);
+        REQUIRE(deferred_reclaimer::pending() == 1);
+        REQUIRE(w_ptr.expired() == true);
+        REQUIRE(w_ptr.lock().get() == nullptr);
+
+        REQUIRE(deferred_reclaimer::drain() == 1);
+        REQUIRE(destroyed == 1);
+        REQUIRE(deferred_reclaimer::pending() == 0);
+    }
+
+    SECTION("Test drain destroys the oldest object first") {
+        std::vector<int> order;
+        struct Recorder {
+            std::vector<int> *order;
+            int id;
+
+            ~Recorder() {
+                order->push_back(id);
+            }
+        };
+
+        for (int i = 0; i < 3; i++)
+            shared_ptr<Recorder, Deferred> ptr = make_shared<Recorder, Deferred>(Recorder{&order, i});
+        order.clear();
+
+        REQUIRE(deferred_reclaimer::drain() == 3);
+        REQUIRE(order == std::vector<int>{0, 1, 2});
+    }
+
+    SECTION("Test releases from many threads") {
+        std::atomic<int> destroyed(0);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; i++) {
+            threads.emplace_back([&destroyed]() {
+                for (int j = 0; j < 100; j++)
+                    shared_ptr<DestructionCounter, Deferred> ptr = make_shared<DestructionCounter, Deferred>(&destroyed);
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        REQUIRE(destroyed == 0);
+        REQUIRE(deferred_reclaimer::drain() == size_t(thread_count * 100));
+        REQUIRE(destroyed == thread_count * 100);
+    }
+
+    SECTION("Test background thread reclaims the queue") {
+        std::atomic<int> destroyed(0);
+        deferred_reclaimer::start(1, std::chrono::milliseconds(1));
+        make_shared<DestructionCounter, Deferred>(&destroyed);
+
+        for (int i = 0; i < 1000 && destroyed == 0; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(destroyed == 1);
+        deferred_reclaimer::stop();
+    }
+
+    SECTION("Test background thread wakes once the threshold is passed") {
+        std::atomic<int> destroyed(0);
+        for (int i = 0; i < 8; i++)
+            make_shared<DestructionCounter, Deferred>(&destroyed);
+
+        // The queue is already past the threshold, so the next push never
+        // brings it exactly to it.
+        deferred_reclaimer::start(4, std::chrono::hours(1));
+        make_shared<DestructionCounter, Deferred>(&destroyed);
+
+        for (int i = 0; i < 1000 && destroyed < 9; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(destroyed == 9);
+        deferred_reclaimer::stop();
+    }
+
+    SECTION("Test pending count with concurrent push and drain") {
+        const int count = 20000;
+        std::atomic<int> destroyed(0);
+        std::atomic<bool> done(false);
+        std::atomic<size_t> max_pending(0);
+
+        std::thread drainer([&]() {
+            while (!done)
+                deferred_reclaimer::drain();
+        });
+        std::thread sampler([&]() {
+            while (!done) {
+                size_t pending = deferred_reclaimer::pending();
+                if (pending > max_pending)
+                    max_pending = pending;
+            }
+        });
+
+        for (int i = 0; i < count; i++)
+            make_shared<DestructionCounter, Deferred>(&destroyed);
+
+        done = true;
+        drainer.join();
+        sampler.join();
+        deferred_reclaimer::drain();
+        REQUIRE(max_pending <= size_t(count));
+        REQUIRE(deferred_reclaimer::pending() == 0);
+        REQUIRE(destroyed == count);
+    }
+
+    SECTION("Test stop flushes the queue") {
+        std::atomic<int> destroyed(0);
+        deferred_reclaimer::start(1000, std::chrono::hours(1));
+        make_shared<DestructionCounter, Deferred>(&destroyed);
+
+        deferred_reclaimer::stop();
+        REQUIRE(destroyed == 1);
+        REQUIRE(deferred_reclaimer::pending() == 0);
+    }
+}
+
+namespace {
+    struct ThreadRecorder {
+        std::thread::id *destroyed_on;
+
+        explicit ThreadRecorder(std::thread::id *destroyed_on) : destroyed_on(destroyed_on) {}
+        ~ThreadRecorder() {
+            *destroyed_on = std::this_thread::get_id();
+        }
+    };
+}
+
+TEST_CASE("Test shared_ptr with owner_thread_policy") {
+    typedef owner_thread_policy<> Owned;
+    std::thread::id destroyed_on;
+
+    SECTION("Test release on the owner thread destroys the object") {
+        shared_ptr<ThreadRecorder, Owned> ptr = make_shared<ThreadRecorder, Owned>(&destroyed_on);
+        ptr.reset();
+        REQUIRE(destroyed_on == std::this_thread::get_id());
+    }
+
+    SECTION("Test remote release goes to the owner's mailbox") {
+        shared_ptr<ThreadRecorder, Owned> ptr = make_shared<ThreadRecorder, Owned>(&destroyed_on);
+        weak_ptr<ThreadRecorder, Owned> w_ptr(ptr);
+        std::thread([&ptr]() {
+            ptr.reset();
+        }).join();
+
+        REQUIRE(destroyed_on == std::thread::id());
+        REQUIRE(w_ptr.expired() == true);
+
+        REQUIRE(Owned::poll() == 1);
+        REQUIRE(destroyed_on == std::this_thread::get_id());
+        REQUIRE(Owned::poll() == 0);
+    }
+
+    SECTION("Test owner drains its mailbox on its next release") {
+        shared_ptr<ThreadRecorder, Owned> remote = make_shared<ThreadRecorder, Owned>(&destroyed_on);
+        std::thread([&remote]() {
+            remote.reset();
+        }).join();
+
+        std::thread::id other_destroyed_on;
+        shared_ptr<ThreadRecorder, Owned> local = make_shared<ThreadRecorder, Owned>(&other_destroyed_on);
+        shared_ptr<ThreadRecorder, Owned> copy(local);
+        copy.reset();
+        REQUIRE(destroyed_on == std::this_thread::get_id());
+    }
+
+    SECTION("Test release after the owner exited") {
+        shared_ptr<ThreadRecorder, Owned> ptr;
+        std::thread([&ptr, &destroyed_on]() {
+            ptr = make_shared<ThreadRecorder, Owned>(&destroyed_on);
+        }).join();
+
+        ptr.reset();
+        REQUIRE(destroyed_on == std::this_thread::get_id());
+    }
+
+    SECTION("Test owner exit destroys the queued objects") {
+        std::atomic<int> destroyed(0);
+        shared_ptr<DestructionCounter, Owned> ptr;
+        std::atomic<bool> created(false);
+        std::atomic<bool> released(false);
+
+        std::thread owner([&ptr, &destroyed, &created, &released]() {
+            ptr = make_shared<DestructionCounter, Owned>(&destroyed);
+            created = true;
+            while (!released)
+                std::this_thread::yield();
+        });
+
+        while (!created)
+            std::this_thread::yield();
+        ptr.reset();
+        REQUIRE(destroyed == 0);
+
+        released = true;
+        owner.join();
+        REQUIRE(destroyed == 1);
+    }
+}
+
+namespace {
+    struct ChainNode {
+        shared_ptr<ChainNode, iterative_policy<>> next;
+        int *destroyed;
+
+        explicit ChainNode(int *destroyed) : destroyed(destroyed) {}
+        ~ChainNode() {
+            (*destroyed)++;
+        }
+    };
+
+    shared_ptr<ChainNode, iterative_policy<>> make_chain(int length, int *destroyed) {
+        shared_ptr<ChainNode, iterative_policy<>> head;
+        for (int i = 0; i < length; i++) {
+            shared_ptr<ChainNode, iterative_policy<>> node = make_shared<ChainNode, iterative_policy<>>(destroyed);
+            node->next = std::move(head);
+            head = std::move(node);
+        }
+
+        return head;
+    }
+}
+
+TEST_CASE("Test shared_ptr with iterative_policy") {
+    int destroyed = 0;
+
+    SECTION("Test a long chain is torn down without recursion") {
+        shared_ptr<ChainNode, iterative_policy<>> head = make_chain(1000000, &destroyed);
+        head.reset();
+        REQUIRE(destroyed == 1000000);
+        REQUIRE(iterative_teardown::pending() == 0);
+    }
+
+    SECTION("Test budget spreads the teardown across calls") {
+        shared_ptr<ChainNode, iterative_policy<>> head = make_chain(100, &destroyed);
+        iterative_teardown::set_budget(10);
+
+        head.reset();
+        REQUIRE(destroyed == 10);
+        REQUIRE(iterative_teardown::pending() == 1);
+
+        REQUIRE(iterative_teardown::drain(20) == 20);
+        REQUIRE(destroyed == 30);
+
+        iterative_teardown::set_budget(SIZE_MAX);
+        REQUIRE(iterative_teardown::drain_for(std::chrono::seconds(10)) == 70);
+        REQUIRE(destroyed == 100);
+        REQUIRE(iterative_teardown::pending() == 0);
+    }
+
+    SECTION("Test objects left on a thread are destroyed at exit") {
+        std::thread([&destroyed]() {
+            shared_ptr<ChainNode, iterative_policy<>> head = make_chain(100, &destroyed);
+            iterative_teardown::set_budget(1);
+            head.reset();
+        }).join();
+
+        REQUIRE(destroyed == 100);
+    }
+}
+
+namespace {
+    struct TreeNode {
+        shared_ptr<TreeNode, iterative_policy<>> left;
+        shared_ptr<TreeNode, iterative_policy<>> right;
+        std::atomic<int> *destroyed;
+
+        explicit TreeNode(std::atomic<int> *destroyed) : destroyed(destroyed) {}
+        ~TreeNode() {
+            destroyed->fetch_add(1);
+        }
+    };
+
+    shared_ptr<TreeNode, iterative_policy<>> make_tree(int depth, std::atomic<int> *destroyed) {
+        shared_ptr<TreeNode, iterative_policy<>> node = make_shared<TreeNode, iterative_policy<>>(destroyed);
+        if (depth > 1) {
+            node->left = make_tree(depth - 1, destroyed);
+            node->right = make_tree(depth - 1, destroyed);
+        }
+
+        return node;
+    }
+}
+
+TEST_CASE("Test parallel_release") {
+    std::atomic<int> destroyed(0);
+
+    SECTION("Test the whole tree is destroyed") {
+        for (size_t threads = 1; threads <= 4; threads++) {
+            destroyed = 0;
+            parallel_release(make_tree(14, &destroyed), threads);
+            REQUIRE(destroyed == (1 << 14) - 1);
+        }
+    }
+
+    SECTION("Test subtrees with other owners survive") {
+        shared_ptr<TreeNode, iterative_policy<>> root = make_tree(10, &destroyed);
+        shared_ptr<TreeNode, iterative_policy<>> kept = root->left;
+
+        parallel_release(std::move(root), thread_count);
+        REQUIRE(destroyed == (1 << 9));
+        REQUIRE(kept.use_count() == 1);
+
+        kept.reset();
+        REQUIRE(destroyed == (1 << 10) - 1);
+    }
+
+    SECTION("Test root with other owners is only released") {
+        shared_ptr<TreeNode, iterative_policy<>> root = make_tree(4, &destroyed);
+        parallel_release(root, thread_count);
+        REQUIRE(destroyed == 0);
+        REQUIRE(root.use_count() == 1);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////// atomic_shared_ptr & atomic_weak_ptr //////////////////
+///////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Test atomic_shared_ptr") {
+    SECTION("Test atomic_shared_ptr default constructor") {
+        atomic_shared_ptr<int> slot;
+        REQUIRE(slot.load().get() == nullptr);
+        REQUIRE(slot.is_lock_free() == true);
+    }
+
+    SECTION("Test atomic_shared_ptr load and store") {
+        shared_ptr<int> ptr = make_shared<int>(5);
+        atomic_shared_ptr<int> slot(ptr);
+        REQUIRE(ptr.use_count() == 2);
+
+        shared_ptr<int> loaded = slot.load();
+        REQUIRE(*loaded == 5);
+        REQUIRE(ptr.use_count() == 3);
+
+        slot.store(make_shared<int>(10));
+        REQUIRE(*slot.load() == 10);
+        REQUIRE(ptr.use_count() == 2);
+
+        slot.store(shared_ptr<int>());
+        REQUIRE(slot.load().get() == nullptr);
+    }
+
+    SECTION("Test atomic_shared_ptr exchange") {
+        atomic_shared_ptr<std::string> slot(make_shared<std::string>("hello"));
+
+        shared_ptr<std::string> previous = slot.exchange(make_shared<std::string>("world"));
+        REQUIRE(*previous == "hello");
+        REQUIRE(previous.use_count() == 1);
+        REQUIRE(*slot.load() == "world");
+    }
+
+    SECTION("Test atomic_shared_ptr compare_exchange_strong") {
+        shared_ptr<int> first = make_shared<int>(1);
+        shared_ptr<int> second = make_shared<int>(2);
+        atomic_shared_ptr<int> slot(first);
+
+        shared_ptr<int> expected = second;
+        REQUIRE(slot.compare_exchange_strong(expected, make_shared<int>(3)) == false);
+        REQUIRE(expected.get() == first.get());
+        REQUIRE(*slot.load() == 1);
+
+        REQUIRE(slot.compare_exchange_strong(expected, second) == true);
+        REQUIRE(slot.load().get() == second.get());
+        REQUIRE(first.use_count() == 2);
+    }
+
+    SECTION("Test atomic_shared_ptr compare_exchange_weak loop") {
+        atomic_shared_ptr<int> slot(make_shared<int>(0));
+
+        shared_ptr<int> expected = slot.load();
+        while (!slot.compare_exchange_weak(expected, make_shared<int>(*expected + 1))) {}
+        REQUIRE(*slot.load() == 1);
+    }
+
+    SECTION("Test atomic_shared_ptr compares the element pointer of aliases") {
+        shared_ptr<std::pair<int, int>> pair = make_shared<std::pair<int, int>>(1, 2);
+        atomic_shared_ptr<int> slot(shared_ptr<int>(pair, &pair->first));
+
+        shared_ptr<int> expected(pair, &pair->second);
+        REQUIRE(slot.compare_exchange_strong(expected, shared_ptr<int>()) == false);
+        REQUIRE(expected.get() == &pair->first);
+        REQUIRE(slot.compare_exchange_strong(expected, shared_ptr<int>()) == true);
+        REQUIRE(slot.load().get() == nullptr);
+    }
+}
+
+TEST_CASE("Test atomic_weak_ptr") {
+    shared_ptr<int> ptr = make_shared<int>(5);
+    atomic_weak_ptr<int> slot(ptr);
+    REQUIRE(ptr.use_count() == 1);
+
+    weak_ptr<int> loaded = slot.load();
+    REQUIRE(*loaded.lock() == 5);
+
+    weak_ptr<int> expected = loaded;
+    shared_ptr<int> other = make_shared<int>(10);
+    REQUIRE(slot.compare_exchange_strong(expected, weak_ptr<int>(other)) == true);
+    REQUIRE(*slot.load().lock() == 10);
+
+    other.reset();
+    REQUIRE(slot.load().expired() == true);
+}
+
+TEST_CASE("Test atomic_shared_ptr with concurrent readers and writers") {
+    std::atomic<int> destroyed(0);
+    std::atomic<int> created(1);
+    {
+        atomic_shared_ptr<DestructionCounter> slot(make_shared<DestructionCounter>(&destroyed));
+        std::atomic<int> broken(0);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; i++) {
+            threads.emplace_back([&slot, &broken]() {
+                for (int j = 0; j < iterations; j++) {
+                    shared_ptr<DestructionCounter> ptr = slot.load();
+                    if (!ptr || ptr.use_count() == 0)
+                        broken++;
+                }
+            });
+        }
+
+        threads.emplace_back([&slot, &destroyed, &created]() {
+            for (int j = 0; j < 1000; j++) {
+                created++;
+                slot.store(make_shared<DestructionCounter>(&destroyed));
+            }
+        });
+        threads.emplace_back([&slot, &destroyed, &created]() {
+            for (int j = 0; j < 1000; j++) {
+                created++;
+                shared_ptr<DestructionCounter> expected = slot.load();
+                slot.compare_exchange_strong(expected, make_shared<DestructionCounter>(&destroyed));
+            }
+        });
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        REQUIRE(broken == 0);
+        REQUIRE(destroyed == created - 1);
+    }
+    REQUIRE(destroyed == created);
+}
+
+///////////////////////////////////////////////////////////////////////////
+////////////////////////// sharded_shared_ptr tests ///////////////////////
+///////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Test sharded_shared_ptr") {
+    SECTION("Test sharded_shared_ptr default constructor") {
+        sharded_shared_ptr<int> ptr;
+        REQUIRE(ptr.get() == nullptr);
+        REQUIRE(ptr.use_count() == 0);
+    }
+
+    SECTION("Test make_sharded and copies") {
+        sharded_shared_ptr<std::string> ptr = make_sharded<std::string>("hello");
+        REQUIRE(*ptr == "hello");
+        REQUIRE(ptr.is_primary() == true);
+        REQUIRE(ptr.use_count() == 1);
+        {
+            sharded_shared_ptr<std::string> copy(ptr);
+            REQUIRE(copy.is_primary() == false);
+            REQUIRE(copy->size() == 5);
+            REQUIRE(ptr.use_count() == 2);
+        }
+        REQUIRE(ptr.use_count() == 1);
+    }
+
+    SECTION("Test get_shared shares the object with shared_ptr") {
+        sharded_shared_ptr<int> ptr = make_sharded<int>(5);
+        shared_ptr<int, atomic_policy> sh_ptr = ptr.get_shared();
+        REQUIRE(sh_ptr.get() == ptr.get());
+
+        ptr.reset();
+        REQUIRE(*sh_ptr == 5);
+        REQUIRE(sh_ptr.use_count() == 1);
+    }
+
+    SECTION("Test object outlives the primary handle") {
+        std::atomic<int> destroyed(0);
+        sharded_shared_ptr<DestructionCounter> ptr = make_sharded<DestructionCounter>(&destroyed);
+        sharded_shared_ptr<DestructionCounter> copy(ptr);
+        sharded_shared_ptr<DestructionCounter> second_copy(copy);
+
+        ptr.reset();
+        REQUIRE(destroyed == 0);
+        REQUIRE(copy.use_count() == 2);
+
+        copy.reset();
+        REQUIRE(destroyed == 0);
+        second_copy.reset();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test concurrent copies while the primary handle is dropped") {
+        std::atomic<int> destroyed(0);
+        for (int i = 0; i < 50; i++) {
+            sharded_shared_ptr<DestructionCounter> ptr = make_sharded<DestructionCounter>(&destroyed);
+
+            std::vector<std::thread> threads;
+            for (int j = 0; j < thread_count; j++) {
+                threads.emplace_back([copy = sharded_shared_ptr<DestructionCounter>(ptr)]() {
+                    std::vector<sharded_shared_ptr<DestructionCounter>> copies;
+                    for (int k = 0; k < 100; k++)
+                        copies.push_back(copy);
+                    for (int k = 0; k < 100; k++) {
+                        sharded_shared_ptr<DestructionCounter> moved(std::move(copies.back()));
+                        copies.pop_back();
+                    }
+                });
+            }
+            ptr.reset();
+
+            for (std::thread &thread : threads)
+                thread.join();
+        }
+
+        REQUIRE(destroyed == 50);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+////////////////////////////// intrusive_ptr tests ////////////////////////
+///////////////////////////////////////////////////////////////////////////
+
+namespace {
+    struct Node : intrusive_ref_counter<Node> {
+        int value;
+        int *destroyed;
+
+        Node(int value, int *destroyed) : value(value), destroyed(destroyed) {}
+        virtual ~Node() {
+            (*destroyed)++;
+        }
+    };
+
+    struct LeafNode : Node {
+        using Node::Node;
+    };
+
+    struct LocalNode : intrusive_ref_counter<LocalNode, single_thread_policy> {
+        int value = 3;
+    };
+
+    // Counts its references by hand and provides the hooks itself.
+    struct Handle {
+        int refs = 0;
+        bool *freed;
+
+        explicit Handle(bool *freed) : freed(freed) {}
+    };
+
+    void add_ref(Handle *handle) {
+        handle->refs++;
+    }
+
+    void release(Handle *handle) {
+        if (--handle->refs == 0) {
+            *handle->freed = true;
+            delete handle;
+        }
+    }
+}
+
+TEST_CASE("Test intrusive_ptr") {
+    int destroyed = 0;
+
+    SECTION("Test intrusive_ptr is one word") {
+        REQUIRE(sizeof(intrusive_ptr<Node>) == sizeof(void *));
+    }
+
+    SECTION("Test intrusive_ptr copy, move and release") {
+        intrusive_ptr<Node> ptr = make_intrusive<Node>(5, &destroyed);
+        REQUIRE(ptr->use_count() == 1);
+
+        intrusive_ptr<Node> copy(ptr);
+        REQUIRE(ptr->use_count() == 2);
+
+        intrusive_ptr<Node> moved(std::move(copy));
+        REQUIRE(copy.get() == nullptr);
+        REQUIRE(ptr->use_count() == 2);
+
+        ptr.reset();
+        REQUIRE(destroyed == 0);
+        REQUIRE(moved->value == 5);
+        moved = intrusive_ptr<Node>();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test raw pointer turned back into an owning pointer") {
+        intrusive_ptr<Node> ptr = make_intrusive<Node>(5, &destroyed);
+        Node *raw = ptr.get();
+
+        intrusive_ptr<Node> owner(raw);
+        REQUIRE(raw->use_count() == 2);
+        ptr.reset();
+        REQUIRE(destroyed == 0);
+        REQUIRE(owner->value == 5);
+    }
+
+    SECTION("Test detach and adopt") {
+        intrusive_ptr<Node> ptr = make_intrusive<Node>(5, &destroyed);
+        Node *raw = ptr.detach();
+        REQUIRE(ptr.get() == nullptr);
+        REQUIRE(raw->use_count() == 1);
+
+        intrusive_ptr<Node> adopted(raw, false);
+        REQUIRE(raw->use_count() == 1);
+        adopted.reset();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test intrusive_ptr converting constructor") {
+        intrusive_ptr<LeafNode> leaf = make_intrusive<LeafNode>(5, &destroyed);
+        intrusive_ptr<Node> node(leaf);
+        REQUIRE(node->use_count() == 2);
+
+        leaf.reset();
+        node.reset();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Test intrusive_ref_counter with single_thread_policy") {
+        intrusive_ptr<LocalNode> ptr = make_intrusive<LocalNode>();
+        intrusive_ptr<LocalNode> copy(ptr);
+        size_t count = copy->use_count();
+        int value = copy->value;
+        ptr.reset();
+        copy.reset();
+
+        REQUIRE(count == 2);
+        REQUIRE(value == 3);
+    }
+
+    SECTION("Test hand-written add_ref and release hooks") {
+        bool freed = false;
+        intrusive_ptr<Handle> ptr(new Handle(&freed));
+        intrusive_ptr<Handle> copy(ptr);
+        int refs = ptr->refs;
+
+        ptr.reset();
+        copy.reset();
+        REQUIRE(refs == 2);
+        REQUIRE(freed == true);
+    }
+
+    SECTION("Test intrusive_ptr across threads") {
+        intrusive_ptr<Node> ptr = make_intrusive<Node>(5, &destroyed);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; i++) {
+            threads.emplace_back([ptr]() {
+                for (int j = 0; j < iterations; j++)
+                    intrusive_ptr<Node> copy(ptr);
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        REQUIRE(ptr->use_count() == 1);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+/////////////////////////// control block pool tests //////////////////////
+///////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Test block_pool") {
+    SECTION("Test a freed block is reused by the same thread") {
+        void *block = block_pool::allocate(24);
+        REQUIRE(reinterpret_cast<uintptr_t>(block) % block_pool::alignment == 0);
+        block_pool::deallocate(block, 24);
+        REQUIRE(block_pool::allocate(32) == block);
+        block_pool::deallocate(block, 32);
+    }
+
+    SECTION("Test large blocks go to operator new") {
+        char *block = static_cast<char *>(block_pool::allocate(block_pool::max_block_size + 1));
+        block[block_pool::max_block_size] = 1;
+        block_pool::deallocate(block, block_pool::max_block_size + 1);
+    }
+
+    SECTION("Test more blocks than one slab holds") {
+        std::vector<void *> blocks;
+        for (size_t i = 0; i < 2 * block_pool::slab_size / 64; i++)
+            blocks.push_back(block_pool::allocate(64));
+
+        std::vector<void *> sorted(blocks);
+        std::sort(sorted.begin(), sorted.end());
+        REQUIRE(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+
+        for (void *block : blocks)
+            block_pool::deallocate(block, 64);
+    }
+
+    SECTION("Test blocks freed to an idle owner are reused") {
+        const size_t size = 480;
+        const size_t count = 200;
+
+        std::vector<void *> blocks;
+        std::atomic<bool> allocated(false);
+        std::atomic<bool> done(false);
+        std::thread owner([&]() {
+            for (size_t i = 0; i < count; i++)
+                blocks.push_back(block_pool::allocate(size));
+            allocated = true;
+            while (!done)
+                std::this_thread::yield();
+        });
+
+        while (!allocated)
+            std::this_thread::yield();
+
+        // The owner does not allocate again, so the blocks stay in its return
+        // list unless another thread takes them.
+        size_t slabs = block_pool::stats(size).slabs;
+        for (void *block : blocks)
+            block_pool::deallocate(block, size);
+
+        blocks.clear();
+        for (size_t i = 0; i < count; i++)
+            blocks.push_back(block_pool::allocate(size));
+        REQUIRE(block_pool::stats(size).slabs == slabs);
+
+        for (void *block : blocks)
+            block_pool::deallocate(block, size);
+        done = true;
+        owner.join();
+    }
+}
+
+TEST_CASE("Test block_pool trimming and statistics") {
+    const size_t size = 400;
+    const size_t count = 3 * block_pool::slab_size / size;
+
+    SECTION("Test high-water mark and trim") {
+        block_pool::size_class_stats before = block_pool::stats(size);
+        REQUIRE(before.block_size == 400);
+
+        std::vector<void *> blocks;
+        for (size_t i = 0; i < count; i++)
+            blocks.push_back(block_pool::allocate(size));
+
+        block_pool::size_class_stats peak = block_pool::stats(size);
+        REQUIRE(peak.slabs >= 3);
+        REQUIRE(peak.peak_slabs == peak.slabs);
+        REQUIRE(peak.blocks_out >= count);
+        REQUIRE(peak.high_water >= peak.blocks_out);
+
+        for (void *block : blocks)
+            block_pool::deallocate(block, size);
+
+        REQUIRE(block_pool::trim() >= peak.slabs * block_pool::slab_size);
+
+        block_pool::size_class_stats after = block_pool::stats(size);
+        REQUIRE(after.slabs == 0);
+        REQUIRE(after.blocks_out == 0);
+        REQUIRE(after.peak_slabs == peak.peak_slabs);
+        REQUIRE(after.high_water == peak.high_water);
+        REQUIRE(after.released_slabs == before.released_slabs + peak.slabs);
+
+        void *block = block_pool::allocate(size);
+        REQUIRE(block_pool::stats(size).slabs == 1);
+        block_pool::deallocate(block, size);
+    }
+
+    SECTION("Test idle slabs are released") {
+        std::vector<void *> blocks;
+        for (size_t i = 0; i < count; i++)
+            blocks.push_back(block_pool::allocate(size));
+        for (void *block : blocks)
+            block_pool::deallocate(block, size);
+
+        size_t released = block_pool::stats(size).released_slabs;
+        block_pool::set_idle_timeout(std::chrono::milliseconds(1));
+
+        // The depot looks for idle slabs as it is used.
+        for (int i = 0; i < 3 && block_pool::stats(size).released_slabs == released; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            blocks.clear();
+            for (size_t j = 0; j < 4 * block_pool::batch_size; j++)
+                blocks.push_back(block_pool::allocate(size));
+            for (void *block : blocks)
+                block_pool::deallocate(block, size);
+        }
+
+        block_pool::set_idle_timeout(std::chrono::milliseconds(0));
+        REQUIRE(block_pool::stats(size).released_slabs > released);
+    }
+
+    SECTION("Test release_idle in a quiet process") {
+        block_pool::trim();
+        std::vector<void *> blocks;
+        for (size_t i = 0; i < count; i++)
+            blocks.push_back(block_pool::allocate(size));
+        for (void *block : blocks)
+            block_pool::deallocate(block, size);
+
+        size_t released = block_pool::stats(size).released_slabs;
+        block_pool::set_idle_timeout(std::chrono::milliseconds(1));
+
+        // Nothing is allocated or freed: only release_idle() scans.
+        size_t bytes = 0;
+        for (int i = 0; i < 100 && !bytes; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            bytes = block_pool::release_idle();
+        }
+
+        block_pool::set_idle_timeout(std::chrono::milliseconds(0));
+        REQUIRE(bytes > 0);
+        REQUIRE(block_pool::stats(size).released_slabs == released + bytes / block_pool::slab_size);
+    }
+
+    SECTION("Test sizes out of range") {
+        REQUIRE_THROWS_AS(block_pool::stats(block_pool::max_block_size + 1), std::out_of_range);
+    }
+}
+
+TEST_CASE("Test make_pooled") {
+    std::atomic<int> destroyed(0);
+
+    SECTION("Test pooled control block") {
+        REQUIRE(sizeof(AllocatedStorage<std::string, pool_allocator<int>>) == sizeof(Storage<std::string>));
+
+        shared_ptr<std::string> ptr = make_pooled<std::string>("hello");
+        weak_ptr<std::string> w_ptr(ptr);
+        REQUIRE(*ptr == "hello");
+        REQUIRE(ptr.use_count() == 1);
+
+        ptr.reset();
+        REQUIRE(w_ptr.expired() == true);
+    }
+
+    SECTION("Test objects released on other threads") {
+        std::vector<shared_ptr<DestructionCounter>> objects;
+        for (int i = 0; i < iterations; i++)
+            objects.push_back(make_pooled<DestructionCounter>(&destroyed));
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; i++) {
+            threads.emplace_back([&objects, &destroyed, i]() {
+                for (int j = i; j < iterations; j += thread_count) {
+                    objects[j].reset();
+                    make_pooled<DestructionCounter>(&destroyed);
+                }
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        REQUIRE(destroyed == 2 * iterations);
+    }
+
+    SECTION("Test objects released after their thread exited") {
+        std::vector<shared_ptr<DestructionCounter>> objects;
+        std::thread([&objects, &destroyed]() {
+            for (int i = 0; i < iterations; i++)
+                objects.push_back(make_pooled<DestructionCounter>(&destroyed));
+        }).join();
+
+        objects.clear();
+        REQUIRE(destroyed == iterations);
+
+        std::thread([&objects, &destroyed]() {
+            for (int i = 0; i < iterations; i++)
+                objects.push_back(make_pooled<DestructionCounter>(&destroyed));
+        }).join();
+
+        objects.clear();
+        REQUIRE(destroyed == 2 * iterations);
+    }
+}
+
+TEST_CASE("Test request_arena") {
+    std::atomic<int> destroyed(0);
+    request_arena arena(1024);
+
+    SECTION("Test objects are destroyed on the last release") {
+        shared_ptr<DestructionCounter> ptr = make_shared_in<DestructionCounter>(arena, &destroyed);
+        weak_ptr<DestructionCounter> w_ptr(ptr);
+        REQUIRE(arena.capacity() == 1024);
+
+        ptr.reset();
+        REQUIRE(destroyed == 1);
+        REQUIRE(w_ptr.expired() == true);
+#ifndef NDEBUG
+        REQUIRE(arena.live_blocks() == 1);
+#endif
+
+        w_ptr.reset();
+#ifndef NDEBUG
+        REQUIRE(arena.live_blocks() == 0);
+#endif
+    }
+
+    SECTION("Test blocks are allocated one after another") {
+        shared_ptr<int> first = make_shared_in<int>(arena, 1);
+        shared_ptr<int> second = make_shared_in<int>(arena, 2);
+        char *first_address = reinterpret_cast<char *>(first.get());
+        char *second_address = reinterpret_cast<char *>(second.get());
+        REQUIRE(second_address - first_address == sizeof(AllocatedStorage<int, arena_allocator<int>>));
+        REQUIRE(*first == 1);
+        REQUIRE(*second == 2);
+    }
+
+    SECTION("Test reset keeps the first chunk") {
+        for (int i = 0; i < 100; i++)
+            make_shared_in<std::string>(arena, "hello");
+        REQUIRE(arena.capacity() > 1024);
+
+        arena.reset();
+        REQUIRE(arena.capacity() == 1024);
+
+        shared_ptr<std::string> ptr = make_shared_in<std::string>(arena, "world");
+        REQUIRE(*ptr == "world");
+        REQUIRE(arena.capacity() == 1024);
+    }
+
+    SECTION("Test a block larger than a chunk") {
+        shared_ptr<std::array<char, 4096>> ptr = make_shared_in<std::array<char, 4096>>(arena);
+        ptr->back() = 1;
+        REQUIRE(arena.capacity() >= 4096);
+
+        ptr.reset();
+        arena.reset();
+        REQUIRE(arena.capacity() == 0);
+    }
+
+    SECTION("Test over-aligned objects") {
+        struct alignas(64) Aligned {
+            char value;
+        };
+
+        make_shared_in<char>(arena, 'a');
+        shared_ptr<Aligned> ptr = make_shared_in<Aligned>(arena);
+        REQUIRE(reinterpret_cast<uintptr_t>(ptr.get()) % 64 == 0);
+    }
+}
+
+namespace {
+    std::atomic<int> pool_full_calls(0);
+
+    void count_pool_full() {
+        pool_full_calls++;
+    }
+
+    struct SmallPool {};
+    struct ThreadedPool {};
+}
+
+TEST_CASE("Test static_pool") {
+    typedef static_pool<std::array<int, 4>, 4, atomic_policy, SmallPool> Pool;
+
+    SECTION("Test a slot holds a control block") {
+        REQUIRE(Pool::slot_size == sizeof(ControlBlock<atomic_policy>) + sizeof(std::array<int, 4>));
+        REQUIRE(Pool::capacity() == 4);
+    }
+
+    SECTION("Test a full pool") {
+        Pool::set_full_handler(count_pool_full);
+        pool_full_calls = 0;
+
+        std::vector<shared_ptr<std::array<int, 4>>> objects;
+        for (int i = 0; i < 4; i++)
+            objects.push_back(Pool::make_shared());
+        REQUIRE(Pool::available() == 0);
+
+        shared_ptr<std::array<int, 4>> ptr = Pool::make_shared();
+        REQUIRE(ptr.get() == nullptr);
+        REQUIRE(pool_full_calls == 1);
+
+        // A slot only comes back once the weak_ptr is gone too.
+        weak_ptr<std::array<int, 4>> w_ptr(objects.back());
+        objects.pop_back();
+        REQUIRE(Pool::available() == 0);
+        w_ptr.reset();
+        REQUIRE(Pool::available() == 1);
+
+        ptr = Pool::make_shared();
+        REQUIRE(ptr.get() != nullptr);
+        REQUIRE(pool_full_calls == 1);
+        Pool::set_full_handler(nullptr);
+    }
+
+    SECTION("Test a slot is returned if the object throws") {
+        typedef static_pool<ThrowingElement, 1> ThrowingPool;
+        ThrowingElement::constructed = 3;
+        REQUIRE_THROWS_AS(ThrowingPool::make_shared(), std::runtime_error);
+        REQUIRE(ThrowingPool::available() == 1);
+    }
+
+    SECTION("Test allocate and release across threads") {
+        typedef static_pool<DestructionCounter, thread_count * 2, atomic_policy, ThreadedPool> SharedPool;
+        std::atomic<int> destroyed(0);
+        std::atomic<int> failures(0);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; i++) {
+            threads.emplace_back([&destroyed, &failures]() {
+                for (int j = 0; j < iterations; j++) {
+                    shared_ptr<DestructionCounter> first = SharedPool::make_shared(&destroyed);
+                    shared_ptr<DestructionCounter> second = SharedPool::make_shared(&destroyed);
+                    if (!first || !second)
+                        failures++;
+                }
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        REQUIRE(failures == 0);
+        REQUIRE(destroyed == 2 * thread_count * iterations);
+        REQUIRE(SharedPool::available() == SharedPool::capacity());
+    }
+}